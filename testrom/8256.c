@@ -32,6 +32,7 @@
 #define I8256_STATUS        I8256_IO + 0x0f
 
 // Function prototypes
+void set_timer2(uint8_t data);
 void set_timer3(uint8_t data);
 uint8_t read_timer3();
 void set_timer5(uint8_t data);
@@ -41,8 +42,10 @@ void set_port1(uint8_t data);
 void set_port2(uint8_t data);
 void set_port1_control(uint8_t data);
 void set_muart_mode(uint8_t data);
+void set_muart_command2(uint8_t data);
 void enable_muart_interrupts(uint8_t data);
 void arm_muart_interrupts(uint8_t data);
+void disable_muart_interrupts(uint8_t data);
 uint8_t read_status();
 void write_buffer(uint8_t txdata);
 uint8_t read_buffer();
@@ -115,6 +118,18 @@ uint8_t read_buffer();
 #define I8256_STATUS_RBF    0x40
 #define I8256_STATUS_INT    0x80
 
+/**
+ * @brief Set Timer 2
+ *
+ * @param data Timer value
+ */
+void set_timer2(uint8_t data) {
+    uint8_t test = data;
+    __asm
+        OUT I8256_TIMER2
+    __endasm;
+}
+
 /**
  * @brief Set Timer 3
  *
@@ -230,6 +245,17 @@ void set_muart_mode(uint8_t data) {
     __endasm;
 }
 
+/**
+ * @brief Write Command Register 2 (baud rate, prescaler and parity)
+ * @param data Command byte (see I8256_CMD2_* defines)
+ */
+void set_muart_command2(uint8_t data) {
+    uint8_t test = data;
+    __asm
+        OUT I8256_CMD2
+    __endasm;
+}
+
 /**
  * @brief Enable Interrupts
  *
@@ -259,6 +285,21 @@ void arm_muart_interrupts(uint8_t data) {
     __endasm;
 }
 
+/**
+ * @brief Clear bits in the MUART interrupt-enable mask
+ *
+ * Register 6 reads back as the interrupt address, but a write resets the
+ * enable bits that are set in the data byte and leaves the other levels alone.
+ *
+ * @param data Interrupt levels to disable
+ */
+void disable_muart_interrupts(uint8_t data) {
+    uint8_t test = data;
+    __asm
+        OUT I8256_INTAD
+    __endasm;
+}
+
 /**
  * @brief Read status from the 8256 MUART
  *
@@ -27,6 +27,9 @@ void set_kdc_clock(uint8_t divider);
 uint8_t read_dram(uint8_t addr);
 void write_dram(uint8_t addr, uint8_t data);
 uint8_t read_sram(uint8_t addr);
+void kdc_read_sram(uint8_t* rows);
+void kdc_read_dram(uint8_t addr, uint8_t* buf, uint8_t count);
+void kdc_write_dram(uint8_t addr, const uint8_t* buf, uint8_t count);
 
 #define I8279_MODE_SET 0x00
 #define I8279_MODE_DISPLAY_8BIT 0x00
@@ -193,4 +196,110 @@ uint8_t read_sram(uint8_t addr) {
     return kdc_data_in();
 }
 
+/*
+ * Burst transfers: one auto-increment command, then one IN or OUT per byte
+ * in a tight loop instead of a command and a call for every address.
+ *
+ * sccz80 pushes the arguments left to right and these functions have no
+ * locals, so on entry the last argument is at SP+2, the one before it at
+ * SP+4 and so on, each in a 16 bit slot.
+ */
+
+/**
+ * @brief Read all 8 bytes of the sensor RAM
+ *
+ * With auto-increment set, reading does not clear the sensor IRQ; send
+ * I8279_END_INTERRUPT afterwards.
+ *
+ * @param rows Destination, 8 bytes
+ */
+void kdc_read_sram(uint8_t* rows) {
+    __asm
+        LXI H,2
+        DAD SP
+        MOV E,M
+        INX H
+        MOV D,M             ; DE = rows
+        MVI A, I8279_READ_SENSOR_RAM | I8279_RW_AUTO_INCREMENT
+        OUT I8279_CMD
+        MVI B,8
+    kdc_read_sram_loop:
+        IN I8279_DATA
+        STAX D
+        INX D
+        DCR B
+        JNZ kdc_read_sram_loop
+    __endasm;
+}
+
+/**
+ * @brief Read consecutive bytes of the display RAM
+ *
+ * @param addr First address in display RAM (0-15)
+ * @param buf Destination
+ * @param count Number of bytes, the address wraps after 15
+ */
+void kdc_read_dram(uint8_t addr, uint8_t* buf, uint8_t count) {
+    __asm
+        LXI H,2
+        DAD SP
+        MOV B,M             ; B = count
+        INX H
+        INX H
+        MOV E,M
+        INX H
+        MOV D,M             ; DE = buf
+        INX H
+        MOV A,M             ; A = addr
+        ANI 0x0F
+        ORI I8279_READ_DISPLAY_RAM | I8279_RW_AUTO_INCREMENT
+        OUT I8279_CMD
+        MOV A,B
+        ORA A
+        JZ kdc_read_dram_done
+    kdc_read_dram_loop:
+        IN I8279_DATA
+        STAX D
+        INX D
+        DCR B
+        JNZ kdc_read_dram_loop
+    kdc_read_dram_done:
+    __endasm;
+}
+
+/**
+ * @brief Write consecutive bytes of the display RAM
+ *
+ * @param addr First address in display RAM (0-15)
+ * @param buf Source
+ * @param count Number of bytes, the address wraps after 15
+ */
+void kdc_write_dram(uint8_t addr, const uint8_t* buf, uint8_t count) {
+    __asm
+        LXI H,2
+        DAD SP
+        MOV B,M             ; B = count
+        INX H
+        INX H
+        MOV E,M
+        INX H
+        MOV D,M             ; DE = buf
+        INX H
+        MOV A,M             ; A = addr
+        ANI 0x0F
+        ORI I8279_WRITE_DISPLAY_RAM | I8279_RW_AUTO_INCREMENT
+        OUT I8279_CMD
+        MOV A,B
+        ORA A
+        JZ kdc_write_dram_done
+    kdc_write_dram_loop:
+        LDAX D
+        OUT I8279_DATA
+        INX D
+        DCR B
+        JNZ kdc_write_dram_loop
+    kdc_write_dram_done:
+    __endasm;
+}
+
 #endif
@@ -1,4 +1,32 @@
 rm a.rom
 rm *.bin
 
-zcc +z80 -clib=8085 -crt0=crt0.asm main.c -create-app $@
+zcc +z80 -clib=8085 -crt0=crt0.asm main.c -create-app -m $@ || exit 1
+
+# Budgets per board, keep in step with the pragmas and RAM_STACK_TOP in
+# main.c: the image has to fit the ROM sockets, and the globals have to end
+# STACK_RESERVE bytes below the initial stack pointer.
+STACK_RESERVE=160
+case "$*" in
+    *BOARD4040*) ROM_MAX=10240; STACK_TOP=0x53fc ;;     # 5 x 2 KB
+    *BOARD4109*) ROM_MAX=32768; STACK_TOP=0x9ff0 ;;
+    *)           ROM_MAX=16384; STACK_TOP=0xc7f0 ;;
+esac
+
+rom=$(wc -c < a.rom)
+ram_end=$(awk '/^__BSS_END_head/ { for (i = 1; i <= NF; i++) if ($i ~ /^\$/) { print substr($i, 2); exit } }' a.map)
+rm a.map
+
+if [ -z "$ram_end" ]; then
+    echo "no __BSS_END_head in the map, cannot check RAM" >&2
+    exit 1
+fi
+echo "ROM $rom of $ROM_MAX bytes, globals end at 0x$ram_end, stack below $STACK_TOP"
+if [ "$rom" -gt "$ROM_MAX" ]; then
+    echo "ROM image too large" >&2
+    exit 1
+fi
+if [ $((0x$ram_end)) -gt $((STACK_TOP - STACK_RESERVE)) ]; then
+    echo "globals run into the stack" >&2
+    exit 1
+fi
@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""
+Decoder for the binary disc and coin captures of the Test ROM
+
+With binary mode on ("BIN 1" on the console, or remote.py), the disc readout
+and coin capture send packed REMOTE_BLOCK_* frames instead of text. This
+script turns them back into the same text the ROM prints in text mode, so
+existing logs and tools keep working.
+
+Usage:
+    python3 capture.py <port> [<item>]     switch to binary, run the capture
+    python3 capture.py --file <raw.bin>    decode a raw serial log
+
+Example:
+    python3 capture.py /dev/ttyUSB0 12
+    python3 capture.py --file disc.bin > disc.txt
+
+<item> is the menu item to run: 12 = disc readout, 13 = coin capture.
+Text between frames is passed through unchanged.
+"""
+
+import sys
+
+from remote import FrameReader, Board
+
+BLOCK_DISC = 0x40
+BLOCK_REST = 0x41
+BLOCK_COIN = 0x42
+
+class Decoder:
+    """Turn capture blocks back into the ROM's text format"""
+
+    def __init__(self, out=sys.stdout):
+        self.out = out
+        self.coin_index = 0
+        self.coin_tz1 = 0xEE    # same seed as menu_coin_capture()
+        self.coin_tz2 = 0xEE
+
+    def block(self, cmd, data):
+        if cmd == BLOCK_DISC:
+            self.disc(data)
+        elif cmd == BLOCK_REST:
+            self.rest(data)
+        elif cmd == BLOCK_COIN:
+            self.coin(data)
+
+    def disc(self, data):
+        steps = data[1] | (data[2] << 8)
+        per_line = data[3]      # steps per revolution
+        bits = data[4:]
+        line = []
+        for step in range(steps):
+            line.append('#' if bits[step >> 3] & (1 << (step & 7)) else '.')
+            if step % per_line == per_line - 1:
+                self.out.write(''.join(line) + '\n')
+                line = []
+        if line:
+            self.out.write(''.join(line) + '\n')
+
+    def rest(self, data):
+        self.out.write("REST TZ0..TZ7: " + ''.join(f"{b:02X} " for b in data) + '\n')
+        self.coin_index = 0
+        self.coin_tz1 = 0xEE
+        self.coin_tz2 = 0xEE
+
+    def coin(self, data):
+        for i in range(0, len(data) - 2, 3):
+            delta, x1, x2 = data[i], data[i + 1], data[i + 2]
+            self.coin_index += delta
+            if x1 == 0 and x2 == 0:
+                continue        # gap filler, no change
+            self.coin_tz1 ^= x1
+            self.coin_tz2 ^= x2
+            self.out.write(f"{self.coin_index:04X}:{self.coin_tz1:02X},{self.coin_tz2:02X}\n")
+
+def decode(source, out=sys.stdout):
+    """Decode every frame from a byte source until it runs dry"""
+    reader = FrameReader(source, echo=out)
+    decoder = Decoder(out)
+    try:
+        while True:
+            seq, cmd, data = reader.read_frame()
+            decoder.block(cmd, data)
+    except TimeoutError:
+        pass
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__)
+        sys.exit(1)
+
+    if sys.argv[1] == '--file':
+        with open(sys.argv[2], 'rb') as f:
+            decode(f)
+        return
+
+    item = int(sys.argv[2]) if len(sys.argv) > 2 else 12
+    board = Board(sys.argv[1], timeout=5)
+    board.set_binary(True)
+    board.port.write(f"{item}\r".encode())
+    decode(board.port)
+    board.set_binary(False)
+
+if __name__ == "__main__":
+    main()
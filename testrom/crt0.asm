@@ -13,6 +13,7 @@
 
         EXTERN    __8085_int1
         EXTERN    __8085_int3
+        EXTERN    __8085_int4
         EXTERN    __8085_int5
         EXTERN    __8085_int7
         EXTERN    __8085_int55
@@ -48,8 +49,7 @@ rst2:   ret                     ;RST2 not used
 rst3:   jp intr3
         defs    $20-ASMPC
 
-rst4:   ei
-        ret                     ;RST4 not used
+rst4:   jp intr4                ;uart rx
         defs    $24-ASMPC
 
 trap:   jp rst7                 ;TRAP not used
@@ -98,6 +98,19 @@ intr3:
         ei
         ret
 
+intr4:
+        push    b
+        push    d
+        push    h
+        push    psw        ; saves A and flags
+        call    __8085_int4
+        pop     psw
+        pop     h
+        pop     d
+        pop     b
+        ei
+        ret
+
 intr5:
         push    b
         push    d
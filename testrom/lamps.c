@@ -0,0 +1,225 @@
+/**
+ * @file lamps.c
+ * @brief Lamp framebuffer, dimming and sequence player driven by the tick
+ *
+ * The 64 lamps are the 8279 display RAM addresses 0-7, one bit per lamp.
+ * Nobody writes them directly any more: write_lamps() and lamp_set_level()
+ * change the framebuffer in RAM, and lamp_tick() puts it on the lamps from
+ * the system tick, one burst write whenever the output changes.
+ *
+ * Dimming uses two bit-planes, lamp_hi and lamp_lo, for four levels per
+ * lamp. A frame is LAMP_SLOTS slots long: lamp_hi is shown for the first two
+ * slots and lamp_lo for the last, so level 3 is always on, level 2 two
+ * thirds and level 1 one third of the time. A slot is longer than one 8279
+ * display scan, so every slot really reaches the lamps.
+ *
+ * A sequence is a ROM table of lamp_step_t played on top of the framebuffer
+ * at full brightness: chases, blinking groups and so on run without any
+ * help from the main code.
+ *
+ * @author stonedDiscord
+ * @date 17.10.2026
+ */
+#ifndef HEADER_LAMPS
+#define HEADER_LAMPS
+
+#define LAMP_SLOT_TICKS 8       // at least one 8279 scan of all 16 digits
+#define LAMP_SLOTS      3       // 2 slots lamp_hi, 1 slot lamp_lo
+
+#define LAMP_SEQ_END    0xFF    // row value that ends a sequence table
+
+/**
+ * @brief One step of a lamp sequence
+ *
+ * Entries with frames = 0 add more lamps to the step of the entry after
+ * them, so one step can light lamps in several rows.
+ */
+struct lamp_step_t {
+    uint8_t row;        // lamp row 0-7, or LAMP_SEQ_END
+    uint8_t mask;       // lamps lit in that row
+    uint8_t frames;     // how long the step is shown, in frames
+};
+
+// Light each lamp of a row in turn for f frames
+#define LAMP_CHASE_ROW(r, f) \
+    {r, 0x01, f}, {r, 0x02, f}, {r, 0x04, f}, {r, 0x08, f}, \
+    {r, 0x10, f}, {r, 0x20, f}, {r, 0x40, f}, {r, 0x80, f}
+
+// Every lamp once, about 200 ms each
+const struct lamp_step_t lamp_seq_chase[] = {
+    LAMP_CHASE_ROW(0, 8), LAMP_CHASE_ROW(1, 8), LAMP_CHASE_ROW(2, 8), LAMP_CHASE_ROW(3, 8),
+    LAMP_CHASE_ROW(4, 8), LAMP_CHASE_ROW(5, 8), LAMP_CHASE_ROW(6, 8), LAMP_CHASE_ROW(7, 8),
+    {LAMP_SEQ_END, 0, 0}
+};
+
+// Even and odd rows blink in turn, about 0.5 s each
+const struct lamp_step_t lamp_seq_blink[] = {
+    {0, 0xFF, 0}, {2, 0xFF, 0}, {4, 0xFF, 0}, {6, 0xFF, 20},
+    {1, 0xFF, 0}, {3, 0xFF, 0}, {5, 0xFF, 0}, {7, 0xFF, 20},
+    {LAMP_SEQ_END, 0, 0}
+};
+
+uint8_t lamp_hi[8];                 // brightness bit 1 of every lamp
+uint8_t lamp_lo[8];                 // brightness bit 0
+uint8_t lamp_anim[8];               // lamps lit by the sequence
+uint8_t lamp_shadow[8];             // last written to display RAM 0-7
+volatile bool lamp_dirty = true;    // framebuffer changed, write even if idle
+
+uint8_t lamp_slot_left = LAMP_SLOT_TICKS;
+uint8_t lamp_slot = 0;
+bool lamp_dimmed = false;           // some lamp at level 1 or 2
+
+const struct lamp_step_t* lamp_seq = 0;
+const struct lamp_step_t* lamp_step;
+uint8_t lamp_frames_left;
+bool lamp_loop;
+
+/**
+ * @brief Load the next step of the sequence into lamp_anim
+ *
+ * Ends or restarts the sequence at LAMP_SEQ_END.
+ */
+void lamp_next_step() {
+    memset(lamp_anim, 0, sizeof(lamp_anim));
+    if (lamp_step->row == LAMP_SEQ_END) {
+        if (!lamp_loop) {
+            lamp_seq = 0;
+            return;
+        }
+        lamp_step = lamp_seq;
+    }
+    while (lamp_step->frames == 0 && lamp_step->row != LAMP_SEQ_END) {
+        lamp_anim[lamp_step->row & 7] |= lamp_step->mask;
+        lamp_step++;
+    }
+    if (lamp_step->row != LAMP_SEQ_END) {
+        lamp_anim[lamp_step->row & 7] |= lamp_step->mask;
+        lamp_frames_left = lamp_step->frames;
+        lamp_step++;
+    } else {
+        lamp_frames_left = 1;       // table ended without a timed step
+    }
+}
+
+/**
+ * @brief Advance the lamps by one timer tick
+ *
+ * Called from the timer 2 tick with interrupts disabled. When the main code
+ * holds the 8279 the write is tried again on the next tick.
+ */
+void lamp_tick() {
+    uint8_t frame[8];
+
+    if (lamp_slot_left && --lamp_slot_left)
+        return;
+    if (kdc_lock_depth)
+        return;                     // slot_left stays 0, retry next tick
+    lamp_slot_left = LAMP_SLOT_TICKS;
+
+    if (++lamp_slot == LAMP_SLOTS) {
+        lamp_slot = 0;
+        if (lamp_seq && --lamp_frames_left == 0) {
+            lamp_next_step();
+            lamp_dirty = true;
+        }
+    }
+
+    // Without dimming both planes are the same, nothing changes per slot
+    if (!lamp_dirty && !lamp_dimmed)
+        return;
+    lamp_dirty = false;
+
+    const uint8_t* plane = lamp_slot < LAMP_SLOTS - 1 ? lamp_hi : lamp_lo;
+    bool changed = false;
+    for (uint8_t row = 0; row < 8; row++) {
+        frame[row] = plane[row] | lamp_anim[row];
+        if (frame[row] != lamp_shadow[row]) {
+            lamp_shadow[row] = frame[row];
+            changed = true;
+        }
+    }
+    if (changed)
+        kdc_write_dram(0, frame, 8);
+}
+
+/**
+ * @brief Recompute lamp_dimmed after a brightness change
+ */
+void lamp_check_dimmed() {
+    bool dimmed = false;
+    for (uint8_t row = 0; row < 8; row++) {
+        if (lamp_hi[row] != lamp_lo[row])
+            dimmed = true;
+    }
+    lamp_dimmed = dimmed;
+}
+
+/**
+ * @brief Switch a whole lamp row, full brightness or off
+ *
+ * @param line Lamp line number (0-7)
+ * @param data One bit per lamp, 1 = on
+ */
+void write_lamps(uint8_t line, uint8_t data) {
+    uint8_t irq = irq_save();
+    lamp_hi[line & 7] = data;
+    lamp_lo[line & 7] = data;
+    lamp_dirty = true;
+    lamp_check_dimmed();
+    irq_restore(irq);
+}
+
+/**
+ * @brief Set the brightness of some lamps of one row
+ *
+ * @param line Lamp line number (0-7)
+ * @param mask Lamps to change
+ * @param level 0 = off, 1 = one third, 2 = two thirds, 3 = full
+ */
+void lamp_set_level(uint8_t line, uint8_t mask, uint8_t level) {
+    uint8_t irq = irq_save();
+    line &= 7;
+    lamp_hi[line] = (level & 2) ? lamp_hi[line] | mask : lamp_hi[line] & ~mask;
+    lamp_lo[line] = (level & 1) ? lamp_lo[line] | mask : lamp_lo[line] & ~mask;
+    lamp_dirty = true;
+    lamp_check_dimmed();
+    irq_restore(irq);
+}
+
+/**
+ * @brief Start playing a lamp sequence on top of the framebuffer
+ *
+ * @param seq Sequence table, ended by LAMP_SEQ_END
+ * @param loop true to start over at the end, false to stop there
+ */
+void lamp_play(const struct lamp_step_t* seq, bool loop) {
+    uint8_t irq = irq_save();
+    lamp_seq = seq;
+    lamp_step = seq;
+    lamp_loop = loop;
+    lamp_next_step();
+    lamp_dirty = true;
+    irq_restore(irq);
+}
+
+/**
+ * @brief Stop the sequence, the framebuffer stays
+ */
+void lamp_stop() {
+    uint8_t irq = irq_save();
+    lamp_seq = 0;
+    memset(lamp_anim, 0, sizeof(lamp_anim));
+    lamp_dirty = true;
+    irq_restore(irq);
+}
+
+/**
+ * @brief Check whether a sequence is still playing
+ *
+ * @return bool true until a sequence without loop has ended
+ */
+bool lamp_playing() {
+    return lamp_seq != 0;
+}
+
+#endif
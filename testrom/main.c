@@ -14,6 +14,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
 
 //#define EMULATOR
 
@@ -62,6 +63,42 @@
 #define RAM_STACK_TOP 0xc7f0
 #endif
 
+// Buffer sizes. On the 4040 the globals and the stack share the 1020 bytes
+// between RAM_BASE and RAM_STACK_TOP, so its buffers are cut down; build.sh
+// checks every board against its RAM and ROM budget.
+#if defined(BOARD4040)
+#define TX_BUF_SIZE     32
+#define RX_BUF_SIZE     16
+#define RX_LINE_SIZE    24
+#define REMOTE_MAX_DATA 32
+#define KEY_QUEUE_SIZE  4
+#define COIN_EVENTS     16
+#define DISC_STEPS      96      // 2 revolutions, the least reel_learn() takes
+#else
+#define TX_BUF_SIZE     64
+#define RX_BUF_SIZE     32
+#define RX_LINE_SIZE    32
+#define REMOTE_MAX_DATA 64
+#define KEY_QUEUE_SIZE  8
+#define COIN_EVENTS     32
+#define DISC_STEPS      240     // 5 revolutions
+#endif
+
+// Settings that survive a reset. They live in the few bytes between the
+// initial stack pointer and the end of RAM, which neither the stack nor the
+// C runtime touches (4 bytes on the 4040, more on the other boards).
+#define SETTINGS_ADD   RAM_STACK_TOP
+#define SETTINGS_MAGIC 0xA5
+
+struct settings_t {
+    uint8_t magic;      // SETTINGS_MAGIC once written
+    uint8_t baud;       // index into baud_table
+    uint8_t keymap;     // index into keymaps
+    uint8_t check;      // complement of the XOR of the bytes above
+};
+
+volatile struct settings_t *settings = (struct settings_t *)SETTINGS_ADD;
+
 enum COUNTER_VALS {
     COUNTERS_START_SOUND = 0x01,
     COUNTERS_GONG        = 0x02,
@@ -75,81 +112,287 @@ enum COUNTER_VALS {
 
 #include "track.c"
 
+// Button events, queued by scan_buttons() and key_timers()
+enum KEY_EVENT {
+    KEY_PRESS   = 0,
+    KEY_REPEAT  = 1,    // still held, auto-repeat is on for this button
+    KEY_LONG    = 2,    // held for key_long_time, once per press
+    KEY_RELEASE = 3,
+};
+
+struct key_event_t {
+    uint8_t row;        // sensor row of the button
+    uint8_t mask;       // its bit in that row
+    uint8_t type;       // KEY_EVENT
+    uint16_t time;      // millis16() when it was seen
+};
+
 // Function prototypes
 void enable_interrupts();
 void disable_interrupts();
+uint8_t irq_save();
+void irq_restore(uint8_t state);
+void write_sim(uint8_t data);
+void mask_rst(uint8_t bits);
+void unmask_rst(uint8_t bits);
 void _8085_int1();
 void _8085_int3();
+void _8085_int4();
 void _8085_int5();
 void _8085_int7();
 void _8085_int65();
-void read_sensor_matrix();
+void kdc_lock();
+void kdc_unlock();
+void blink_write();
 void calibrate_buttons();
 void scan_buttons();
+void set_debounce(uint8_t row, uint8_t samples);
 void _8085_int75();
 void _8085_int55();
 void counter_out(uint8_t data);
 void set_sound(uint8_t note);
-void wait_timer3(uint8_t data);
 void write_lamps(uint8_t line, uint8_t data);
+void lamp_tick();
+void lamp_set_level(uint8_t line, uint8_t mask, uint8_t level);
+void lamp_stop();
+bool lamp_playing();
+void reel_tick();
 void write_money(uint8_t digit, uint8_t value);
 void write_service(uint8_t digit, uint8_t value);
 void write_both(uint8_t digit, uint8_t value);
 void refresh_display();
 void write_serie(uint8_t number);
+uint8_t glyph(char c);
+void display_text(uint8_t pos, const char* text);
+void display_scroll(const char* text);
+void display_scroll_stop();
+void display_scroll_tick();
+void display_scroll_update();
 void init_kdc();
 void init_muart();
+void settings_load();
+void settings_save();
+void set_baud(uint8_t index);
+bool autobaud();
 void init_ppi();
+void init_tick();
+void init_blink();
+uint32_t millis();
+uint16_t millis16();
+uint16_t elapsed_since(uint16_t start);
+bool deadline_passed(uint16_t deadline);
+void sleep_until(uint16_t deadline);
 void delay(uint16_t ms);
-void dumb_delay(uint16_t ms);
-void wait_tx_ready();
+void tx_poll();
+void tx_kick();
+bool tx_try_put(uint8_t txdata);
+uint8_t tx_free();
 void print_serial_char(uint8_t txdata);
+void serial_flush();
 uint8_t read_serial_char();
+bool serial_available();
+bool serial_getline(char* buf, uint8_t len);
+bool remote_rx_byte(uint8_t c, bool start_ok);
+void handle_serial_line(const char* line);
 void print_string(const char* str);
 void print_hex8(uint8_t v);
-void menu_8256_test();
-void menu_8279_test();
-void menu_ram_test();
-void menu_rtc_test();
-void menu_disc_readout();
-void menu_coin_capture();
-void play_note(uint8_t note, uint8_t octave, uint8_t duration);
-void play_track();
-bool check_button(uint8_t button);
-bool check_button_edge(uint8_t button);
-bool test_cancelled();
+void print_dec(uint16_t v);
+uint16_t parse_dec(const char* str);
+void run_menu_item(uint8_t item);
+bool test_running();
+void test_end();
+void test_cancel();
+void remote_test_done(uint8_t item);
+void music_tick();
+void music_note_end();
+void keymap_set(uint8_t index);
+void keymap_print();
+void keymap_next();
+bool key_post(uint8_t row, uint8_t mask, uint8_t type);
+bool key_get(struct key_event_t* ev);
+void key_timers();
+void key_set_repeat(uint8_t button, bool on);
+void key_set_timing(uint16_t repeat_delay, uint16_t repeat_rate, uint16_t long_time);
+uint8_t button_actions(uint8_t row, uint8_t mask);
+void handle_key(uint8_t actions);
+void handle_buttons();
 void display_rtc_date();
 void display_rtc_time();
 
+#include "task.c"
+
+uint8_t menu_8256_test(struct task_t* t);
+uint8_t menu_8279_test(struct task_t* t);
+uint8_t menu_ram_test(struct task_t* t);
+uint8_t menu_rtc_test(struct task_t* t);
+uint8_t menu_disc_readout(struct task_t* t);
+uint8_t menu_coin_capture(struct task_t* t);
+uint8_t menu_lamp_test(struct task_t* t);
+uint8_t display_task(struct task_t* t);
+uint8_t keys_task(struct task_t* t);
+uint8_t serial_task(struct task_t* t);
+
 volatile struct rtc_state_t *rtc;
 
 #define COINS       0x70
 #define COUNTERS    0x71
 #define SOUND       0x72
 
-volatile bool timer3_flag = false;
 volatile bool blink_flag = false;
 bool date_edit_mode = false;
 bool time_edit_mode = false;
 int8_t selected_digit = -1;
 int8_t menu_item = 0;
 
+// Sensor snapshots, filled by the 8279 interrupt (RST6.5). The ISR reads
+// into the half that is not current, then flips sensor_snap_cur, so the main
+// code never sees a half-written snapshot.
+uint8_t sensor_snap[2][8];
+volatile uint8_t sensor_snap_cur = 0;
+volatile uint8_t sensor_changed = 0;    // rows that changed since the last scan, bit n = row n
+uint8_t sensor_unsettled = 0;           // rows still waiting for debounce
+uint8_t kdc_lock_depth = 0;             // RST6.5 held off while non-zero
+
 uint8_t sensor_ram[8];        // raw current sample
-uint8_t sensor_prev[8];       // previous raw sample (for debounce)
 uint8_t sensor_debounced[8];  // confirmed stable state
+
+// Vertical counter debouncer: bit n of debounce_c0/c1/c2[row] together form
+// a 3 bit down counter for the button in column n, so one byte operation
+// handles a whole row. A counter is reloaded with debounce_preset[row]
+// (samples - 1) while its button agrees with sensor_debounced.
+#define DEBOUNCE_PANEL  4       // samples for the panel and service buttons
+#define DEBOUNCE_COIN   2       // coin rows TZ1/TZ2 need a fast response
+uint8_t debounce_c0[8];
+uint8_t debounce_c1[8];
+uint8_t debounce_c2[8];
+uint8_t debounce_preset[8] = {
+    DEBOUNCE_PANEL - 1, DEBOUNCE_COIN - 1, DEBOUNCE_COIN - 1, DEBOUNCE_PANEL - 1,
+    DEBOUNCE_PANEL - 1, DEBOUNCE_PANEL - 1, DEBOUNCE_PANEL - 1, DEBOUNCE_PANEL - 1,
+};
 uint8_t sensor_baseline[8];   // boot "rest" state - presses are deviations from this
 uint8_t pressed_prev[8];      // pressed state from previous scan (for edge detection)
-uint8_t button_edge[8];       // bits that went pressed since last scan (rising edge)
 uint8_t sensor_row = 0;
 
-// Software blink: toggle blink_flag every BLINK_PERIOD main-loop iterations.
-// Tune to taste - higher = slower blink. (Timer 5 ISR blink is not enabled.)
-#define BLINK_PERIOD 25
-uint16_t blink_counter = 0;
+// Hardware blink: timer 5 (level 7, RST7) toggles blink_flag and writes the
+// selected digit's byte for the new phase straight into display RAM.
+// 250 counts of the 1.024 kHz timer clock are about 244 ms per phase.
+#define BLINK_COUNTS 250
+volatile int8_t blink_digit = -1;   // digit the ISR blinks, -1 = none
+uint8_t blink_frame[2];             // its byte for the off and the on phase
+volatile bool blink_pending = false;    // phase changed while the 8279 was locked
+
+// While a digit is edited the clock on the display is re-read this often
+#define CLOCK_PERIOD 250
+uint16_t clock_deadline = 0;
+
+// Task periods in milliseconds
+#define DISPLAY_PERIOD  20
+#define KEYS_PERIOD     10
 
 uint8_t money_display[8];
 uint8_t service_display[8];
 
+// Digit bytes last written to the 8279 (display RAM 8-15). init_kdc()
+// clears the display RAM to zero, which is where this starts.
+uint8_t display_shadow[8];
+bool display_dirty = true;          // a digit was written since the last refresh
+int8_t shown_selected = -1;         // selected_digit in display_shadow
+
+// System tick: timer 2 (level 1, RST1) fires on every count of the 1.024 kHz
+// timer clock. 1024 ticks make 1000 ms, so 3 of every 128 ticks do not
+// advance the millisecond counter and millis() stays exact over time.
+#define TICK_COUNTS     1
+#define TICK_DROP       3
+#define TICK_PERIOD     128
+volatile uint32_t tick_ms = 0;
+volatile uint8_t tick_frac = 0;
+
+// Outcome of each service menu item, read back by the remote protocol
+#define MENU_ITEMS 14
+enum TEST_RESULT {
+    RESULT_NONE      = 0,   // not run since boot
+    RESULT_DONE      = 1,   // ran, no pass/fail verdict (lamps, readouts)
+    RESULT_PASS      = 2,
+    RESULT_FAIL      = 3,
+    RESULT_CANCELLED = 4,
+    RESULT_RUNNING   = 5,
+};
+uint8_t test_result[MENU_ITEMS];
+uint8_t test_verdict;               // set by the running test
+
+// What the digits show for a menu test. They only have the codes 0-9, A,
+// b, C, d and E, so a test is named by its menu number and a hex-style tag
+// on the money display, and its verdict is one code on the service display.
+//
+//   label     test                     verdict
+//   06 8255   lamps (8255 PPI)         d  done, no pass/fail verdict
+//   08 8256   MUART timers             A  pass (accepted)
+//   09 8279   display/key controller   E  fail (error)
+//   10 5000   RAM from RAM_BASE        C  cancelled
+//   11 6818   RTC (62421 on the 4109)
+//   12 d15C   disc readout
+//   13 C0     coin capture
+//
+// The tests show their readings on service digits 3-0.
+#if defined(BOARD4040)
+#define LABEL_RAM   "10 5000 "
+#define LABEL_RTC   "11 6818 "
+#elif defined(BOARD4109)
+#define LABEL_RAM   "10 9000 "
+#define LABEL_RTC   "11 62421"
+#else // BOARD4087
+#define LABEL_RAM   "10 C000 "
+#define LABEL_RTC   "11 6818 "
+#endif
+
+// Verdict per TEST_RESULT, four characters
+const char* const result_words[] = {
+    "    ",
+    "d   ",
+    "A   ",
+    "E   ",
+    "C   ",
+    "    ",
+};
+
+// The menu test currently running as a task, at most one at a time
+struct task_t* test_task = 0;
+task_fn test_body;                  // the test's own protothread
+void (*test_stop)();                // undoes hardware state on cancel, or 0
+uint8_t test_item;
+
+// Capture tests send packed REMOTE_BLOCK_* frames instead of text when set
+bool capture_binary = false;
+
+// Serial transmit queue, drained by the transmitter interrupt (level 5, RST5).
+// print_serial_char() only enqueues; the ISR feeds the 8256 one byte per
+// "transmit buffer empty" interrupt. TX_BUF_SIZE must be a power of two.
+uint8_t tx_buf[TX_BUF_SIZE];
+volatile uint8_t tx_head = 0;       // next free slot (main code)
+volatile uint8_t tx_tail = 0;       // next byte to send (ISR)
+volatile bool tx_active = false;    // level 5 armed, the ISR owns the chain
+
+// 8085 SIM: mask bits for the RST5.5/6.5/7.5 inputs, all masked after reset
+#define SIM_MASK_55     0x01
+#define SIM_MASK_65     0x02
+#define SIM_MASK_75     0x04
+#define SIM_MSE         0x08    // mask set enable
+uint8_t sim_mask = SIM_MASK_55 | SIM_MASK_65 | SIM_MASK_75;
+
+// Serial receive queue, filled by the receiver interrupt (level 4, RST4) so
+// bytes arriving while a test is running are not lost. RX_BUF_SIZE must be a
+// power of two.
+uint8_t rx_buf[RX_BUF_SIZE];
+volatile uint8_t rx_head = 0;       // next free slot (ISR)
+volatile uint8_t rx_tail = 0;       // next byte to read (main code)
+volatile uint16_t rx_overrun = 0;   // 8256 OE: byte lost inside the MUART
+volatile uint16_t rx_framing = 0;   // 8256 FE
+volatile uint16_t rx_parity = 0;    // 8256 PE
+volatile uint16_t rx_dropped = 0;   // queue full, byte thrown away
+
+// Line assembly for serial_getline(), in the caller's buffer
+uint8_t rx_line_len = 0;
+
 /**
  * @brief Enable Interrupts
  *
@@ -170,38 +413,200 @@ void disable_interrupts() {
     __endasm;
 }
 
-// timer2
+/**
+ * @brief Disable interrupts and return the previous enable state
+ *
+ * RIM reports the interrupt-enable flip-flop in bit 3, so a critical section
+ * opened with this can be used from ISRs and DI regions without turning
+ * interrupts back on behind the caller's back.
+ *
+ * @return uint8_t Non-zero if interrupts were enabled
+ */
+uint8_t irq_save() {
+    uint8_t out=0xaa;
+    __asm
+        POP HL
+        RIM
+        DI
+        MOV L,A
+        PUSH HL
+    __endasm;
+    return out & 0x08;
+}
+
+/**
+ * @brief Re-enable interrupts if they were enabled before irq_save()
+ *
+ * @param state Value returned by irq_save()
+ */
+void irq_restore(uint8_t state) {
+    if (state)
+        enable_interrupts();
+}
+
+/**
+ * @brief Write the 8085 interrupt mask (SIM)
+ *
+ * @param data SIM_MSE plus the mask bits
+ */
+void write_sim(uint8_t data) {
+    uint8_t test = data;
+    __asm
+        SIM
+    __endasm;
+}
+
+/**
+ * @brief Mask RST5.5/6.5/7.5 inputs, leaving the others as they are
+ *
+ * @param bits SIM_MASK_* bits to mask
+ */
+void mask_rst(uint8_t bits) {
+    uint8_t irq = irq_save();
+    sim_mask |= bits;
+    write_sim(sim_mask | SIM_MSE);
+    irq_restore(irq);
+}
+
+/**
+ * @brief Unmask RST5.5/6.5/7.5 inputs, leaving the others as they are
+ *
+ * @param bits SIM_MASK_* bits to unmask
+ */
+void unmask_rst(uint8_t bits) {
+    uint8_t irq = irq_save();
+    sim_mask &= ~bits;
+    write_sim(sim_mask | SIM_MSE);
+    irq_restore(irq);
+}
+
+// timer2 - system tick
 void _8085_int1() {
-    // unused
+    // Reloading here costs no time: the prescaler keeps running, so as long
+    // as this happens before its next edge the period stays one count.
+    set_timer2(TICK_COUNTS);
+    tick_frac += TICK_DROP;
+    if (tick_frac >= TICK_PERIOD)
+        tick_frac -= TICK_PERIOD;
+    else
+        tick_ms++;
+    music_tick();
+    lamp_tick();
+    reel_tick();
+    display_scroll_tick();
 }
 // timer3
 void _8085_int3() {
-    timer3_flag = false;
+    // unused, timer 3 is only ever polled
+}
+// rx int
+void _8085_int4() {
+    uint8_t status = read_status();
+    if (status & I8256_STATUS_OE) rx_overrun++;
+    if (status & I8256_STATUS_FE) rx_framing++;
+    if (status & I8256_STATUS_PE) rx_parity++;
+
+    if (status & I8256_STATUS_RBF) {
+        uint8_t data = read_buffer();
+        uint8_t next = (rx_head + 1) & (RX_BUF_SIZE - 1);
+        if (next == rx_tail) {
+            rx_dropped++;
+        } else {
+            rx_buf[rx_head] = data;
+            rx_head = next;
+        }
+    }
 }
+
 // tx int
 void _8085_int5() {
-    // unused
+    if ((read_status() & I8256_STATUS_TBE) == 0)
+        return;                     // not ours to fill yet
+
+    if (tx_tail != tx_head) {
+        write_buffer(tx_buf[tx_tail]);
+        tx_tail = (tx_tail + 1) & (TX_BUF_SIZE - 1);
+    } else {
+        // Queue drained: mask level 5 until the next print kicks it again
+        disable_muart_interrupts(I8256_INT_L5);
+        tx_active = false;
+    }
 }
-//timer5
+//timer5 - display blink
 void _8085_int7() {
+    // The INTA cycle has already cleared the request (NIE is off, so there
+    // is no END to send); timer 5 stops at zero and must be reloaded.
+    set_timer5(BLINK_COUNTS);
     blink_flag = !blink_flag;
-    // Keep this minimal - only hardware register operations
-    set_timer5(250);
+    if (blink_digit < 0)
+        return;
+    if (kdc_lock_depth)
+        blink_pending = true;       // kdc_unlock() writes it
+    else
+        blink_write();
 }
 
 /**
  * @brief Keyboard/display controller interrupt handler RST65
  *
- * Currently a placeholder function.
+ * In sensor matrix mode the 8279 raises IRQ when any sensor changes and
+ * stops updating its sensor RAM until END_INTERRUPT. Read the new state into
+ * the spare snapshot, post the rows that changed and let the 8279 go on.
+ * The main code holds this off with kdc_lock() while it talks to the 8279.
  */
 void _8085_int65() {
-    //read_sensor_matrix();
-}
+    uint8_t* prev = sensor_snap[sensor_snap_cur];
+    uint8_t* next = sensor_snap[sensor_snap_cur ^ 1];
+    uint8_t changed = 0;
 
-void read_sensor_matrix() {
+    kdc_read_sram(next);
+    kdc_cmd_out(I8279_END_INTERRUPT);
     for (uint8_t row = 0; row < 8; row++) {
-        sensor_ram[row] = read_sram(row);
+        if (next[row] != prev[row])
+            changed |= 1 << row;
+    }
+    sensor_snap_cur ^= 1;
+    sensor_changed |= changed;
+}
+
+/**
+ * @brief Keep the 8279 interrupt out while the main code uses the 8279
+ *
+ * A command and its data are two separate accesses; the ISR's own sensor
+ * RAM reads in between would move the 8279's address pointer. The blink
+ * ISR leaves the display alone meanwhile. Calls nest.
+ */
+void kdc_lock() {
+    mask_rst(SIM_MASK_65);
+    kdc_lock_depth++;
+}
+
+/**
+ * @brief Let the 8279 interrupt in again after kdc_lock()
+ *
+ * A sensor change seen meanwhile is still pending and is taken right away.
+ */
+void kdc_unlock() {
+    uint8_t irq = irq_save();
+    if (--kdc_lock_depth == 0) {
+        if (blink_pending)
+            blink_write();
+        unmask_rst(SIM_MASK_65);
     }
+    irq_restore(irq);
+}
+
+/**
+ * @brief Show the blinking digit in the current blink phase
+ *
+ * Called with interrupts disabled and the 8279 free.
+ */
+void blink_write() {
+    uint8_t data = blink_frame[blink_flag];
+    blink_pending = false;
+    display_shadow[blink_digit] = data;
+    kdc_cmd_out(I8279_WRITE_DISPLAY_RAM | (8 + blink_digit));
+    kdc_data_out(data);
 }
 
 /**
@@ -216,40 +621,98 @@ void read_sensor_matrix() {
  *       reads as released until it is released and pressed again.
  */
 void calibrate_buttons() {
-    read_sensor_matrix();
-    for (uint8_t row = 0; row < 8; row++) {
-        sensor_prev[row] = sensor_ram[row];
-    }
-    dumb_delay(50);
-    read_sensor_matrix();
+    kdc_lock();
+    kdc_read_sram(sensor_ram);      // first sample after reset, thrown away
+    kdc_unlock();
+    delay(50);
+    kdc_lock();
+    kdc_read_sram(sensor_ram);
+    kdc_cmd_out(I8279_END_INTERRUPT);
     for (uint8_t row = 0; row < 8; row++) {
+        sensor_snap[0][row]   = sensor_ram[row];
+        sensor_snap[1][row]   = sensor_ram[row];
         sensor_baseline[row]  = sensor_ram[row];
         sensor_debounced[row] = sensor_ram[row];
-        sensor_prev[row]      = sensor_ram[row];
         pressed_prev[row]     = 0;   // nothing pressed relative to baseline yet
-        button_edge[row]      = 0;
+        set_debounce(row, debounce_preset[row] + 1);
     }
+    sensor_changed = 0;
+    sensor_unsettled = 0;
+    kdc_unlock();           // from here on the RST6.5 ISR keeps the snapshot
+}
+
+/**
+ * @brief Set how many samples a button row must agree before a change counts
+ *
+ * @param row Sensor row (0-7)
+ * @param samples 1 (no filtering) to 8 consecutive scans
+ */
+void set_debounce(uint8_t row, uint8_t samples) {
+    uint8_t preset;
+
+    if (samples < 1) samples = 1;
+    if (samples > 8) samples = 8;
+    preset = samples - 1;
+    row &= 7;
+    debounce_preset[row] = preset;
+    debounce_c0[row] = (preset & 1) ? 0xFF : 0x00;
+    debounce_c1[row] = (preset & 2) ? 0xFF : 0x00;
+    debounce_c2[row] = (preset & 4) ? 0xFF : 0x00;
 }
 
 /**
  * @brief Sample the button matrix with software debouncing
  *
- * Only bits that read the same as the previous scan are committed to the
- * debounced state, so a button must be stable for two consecutive scans
- * before its change is registered.
+ * Every button that reads different from its debounced state counts its
+ * vertical counter down; a button that reads the same has it reloaded. The
+ * change is taken when the counter is already zero, i.e. after the row's
+ * number of consecutive differing samples. Only rows the RST6.5 ISR
+ * reported as changed, or that are still counting, are looked at; the
+ * others cannot have new edges. Every press and release is queued as a key
+ * event.
  */
 void scan_buttons() {
-    read_sensor_matrix();
+    uint8_t irq = irq_save();
+    uint8_t rows = sensor_changed | sensor_unsettled;
+    const uint8_t* snap = sensor_snap[sensor_snap_cur];
+    sensor_changed = 0;
     for (uint8_t row = 0; row < 8; row++) {
-        uint8_t stable = ~(sensor_ram[row] ^ sensor_prev[row]); // bits unchanged this scan
-        sensor_debounced[row] = (sensor_debounced[row] & ~stable)
-                              | (sensor_ram[row]       &  stable);
-        sensor_prev[row] = sensor_ram[row];
+        if (rows & (1 << row))
+            sensor_ram[row] = snap[row];
+    }
+    irq_restore(irq);
 
-        // rising-edge: bits pressed now (vs baseline) that were not pressed last scan
+    sensor_unsettled = 0;
+    for (uint8_t row = 0; row < 8; row++) {
+        if (!(rows & (1 << row)))
+            continue;
+        uint8_t delta = sensor_ram[row] ^ sensor_debounced[row];
+        uint8_t c0 = debounce_c0[row];
+        uint8_t c1 = debounce_c1[row];
+        uint8_t zero = ~(c0 | c1 | debounce_c2[row]);
+        uint8_t preset = debounce_preset[row];
+
+        // Take the changes whose counters ran out, count the others down,
+        // reload where nothing differs (the presets are all-0 or all-1 bytes)
+        sensor_debounced[row] ^= delta & zero;
+        uint8_t dec = delta & ~zero;
+        debounce_c2[row] = ((debounce_c2[row] ^ (~c0 & ~c1)) & dec) | (-((preset >> 2) & 1) & ~dec);
+        debounce_c1[row] = ((c1 ^ ~c0) & dec)                       | (-((preset >> 1) & 1) & ~dec);
+        debounce_c0[row] = (~c0 & dec)                              | (-(preset & 1) & ~dec);
+
+        // pressed = deviates from the baseline; post what changed since last scan
         uint8_t pressed = sensor_debounced[row] ^ sensor_baseline[row];
-        button_edge[row] = pressed & ~pressed_prev[row];
+        uint8_t edges = pressed ^ pressed_prev[row];
         pressed_prev[row] = pressed;
+        for (uint8_t mask = 1; edges; mask <<= 1) {
+            if (edges & mask) {
+                key_post(row, mask, (pressed & mask) ? KEY_PRESS : KEY_RELEASE);
+                edges &= ~mask;
+            }
+        }
+
+        if (delta)
+            sensor_unsettled |= 1 << row;   // one more pass to count or reload
     }
 }
 
@@ -265,11 +728,10 @@ void _8085_int75() {
 /**
  * @brief Sound interrupt handler RST55
  *
- * Currently a placeholder function.
+ * The sound board signals the end of a note.
  */
 void _8085_int55() {
-    // unused
-    enable_interrupts();
+    music_note_end();
 }
 
 /**
@@ -296,26 +758,6 @@ void set_sound(uint8_t note) {
     __endasm;
 }
 
-void wait_timer3(uint8_t data) {
-    timer3_flag = true;
-    set_timer3(data); // Set timer value as needed
-    enable_muart_interrupts(I8256_INT_L3);
-    while (timer3_flag) {
-        // Wait for timer3_flag to be cleared in interrupt
-    }
-}
-
-/**
- * @brief Write data to indicator lamps
- *
- * @param line Lamp line number (0-7)
- * @param data Data to write to the lamp line
- */
-void write_lamps(uint8_t line, uint8_t data) {
-    kdc_cmd_out(I8279_WRITE_DISPLAY_RAM | (line & 7));
-    kdc_data_out(data);
-}
-
 /**
  * @brief Write data to 7-segment display digits
  *
@@ -324,60 +766,62 @@ void write_lamps(uint8_t line, uint8_t data) {
  * @param srv Digit on the service display
  */
 void write_money(uint8_t digit, uint8_t value) {
-    money_display[digit] = value;
+    if (money_display[digit] != value) {
+        money_display[digit] = value;
+        display_dirty = true;
+    }
 }
 
 void write_service(uint8_t digit, uint8_t value) {
-    service_display[digit] = value;
+    if (service_display[digit] != value) {
+        service_display[digit] = value;
+        display_dirty = true;
+    }
 }
 
 void write_both(uint8_t digit, uint8_t value) {
-    money_display[digit] = value;
-    service_display[digit] = value;
-}
-
-void update_blink()
-{
-    if (date_edit_mode)
-        display_rtc_date();
-
-    if (time_edit_mode)
-        display_rtc_time();
-
-    // Clear all blink flags first
-    for (uint8_t digit = 0; digit < 8; digit++) {
-        money_display[digit] &= 0x0F;
-        service_display[digit] &= 0x0F;
-    }
-
-    // Set the blink flag for the selected digit
-    if (selected_digit >= 0 && selected_digit < 8) {
-    money_display[selected_digit] |= 0xF0;
-    service_display[selected_digit] |= 0xF0;
-    }    
+    write_money(digit, value);
+    write_service(digit, value);
 }
 
+/**
+ * @brief Bring the 8279 digits up to date
+ *
+ * The frame is only rebuilt when a digit was written or the selected digit
+ * moved. Only the run of bytes that differ from display_shadow is sent to
+ * the 8279. The selected digit's byte for both blink phases is handed to
+ * the timer 5 ISR, which does the blinking from then on.
+ */
 void refresh_display() {
-    update_blink();
-    kdc_cmd_out(I8279_WRITE_DISPLAY_RAM | I8279_RW_AUTO_INCREMENT | 8);
-    for (uint8_t digit = 0; digit < 8; digit++) {
-
-        // blink logic: if any of the upper nibbles are set, blink the digit
-        uint8_t money_digit, service_digit;
+    uint8_t frame[8];
+    uint8_t first = 8, last = 0;
 
-        if ((money_display[digit] >> 4) && blink_flag)
-           money_digit = 0xf0;
-        else
-           money_digit = money_display[digit] << 4;
+    if (!display_dirty && shown_selected == selected_digit)
+        return;
+    display_dirty = false;
+    shown_selected = selected_digit;
 
+    kdc_lock();     // the blink ISR keeps its hands off from here
+    for (uint8_t digit = 0; digit < 8; digit++) {
+        frame[digit] = (money_display[digit] << 4) | (service_display[digit] & 0x0f);
+        if (digit == selected_digit) {
+            // blank (0xF) in the on phase
+            blink_frame[0] = frame[digit];
+            blink_frame[1] = 0xff;
+            frame[digit] = blink_frame[blink_flag];
+        }
 
-        if ((service_display[digit] >> 4) && blink_flag)
-           service_digit = 0x0f;
-        else
-           service_digit = service_display[digit] & 0x0f;
-        
-        kdc_data_out(money_digit | service_digit);
+        if (frame[digit] != display_shadow[digit]) {
+            if (first > digit)
+                first = digit;
+            last = digit;
+            display_shadow[digit] = frame[digit];
+        }
     }
+    blink_digit = selected_digit;
+    if (first <= last)
+        kdc_write_dram(8 + first, frame + first, last - first + 1);
+    kdc_unlock();
 }
 
 /**
@@ -396,6 +840,158 @@ void write_serie(uint8_t number) {
         write_money(5, ones);
 }
 
+// Text on the digits. Each digit only takes a 4 bit code (0-9, A, b, C, d,
+// E, blank). I, O, S and Z use the digit with the same segments, every
+// other letter is blank. Two codes per byte, high nibble first, for ASCII
+// 0x20-0x5F; lower case is folded.
+const uint8_t glyph_table[32] = {
+    0xFF, 0xFF, 0xFF, 0xFF,   //  !"#$%&'
+    0xFF, 0xFF, 0xFF, 0xFF,   // ()*+,-./
+    0x01, 0x23, 0x45, 0x67,   // 01234567
+    0x89, 0xFF, 0xFF, 0xFF,   // 89:;<=>?
+    0xFA, 0xBC, 0xDE, 0xFF,   // @ABCDEFG
+    0xF1, 0xFF, 0xFF, 0xF0,   // HIJKLMNO
+    0xFF, 0xF5, 0xFF, 0xFF,   // PQRSTUVW
+    0xFF, 0x2F, 0xFF, 0xFF,   // XYZ[\]^_
+};
+
+// The money and service displays side by side make one 16 digit strip:
+// positions 0-7 are the money digits left to right, 8-15 the service digits.
+#define TEXT_DIGITS     16
+#define SCROLL_PERIOD   300     // ms per step
+#define SCROLL_GAP      4       // blanks between the end and the start again
+
+const char* scroll_text = 0;    // text being scrolled, 0 = none
+uint8_t scroll_len;
+uint8_t scroll_pos;
+uint16_t scroll_left;           // ms to the next step
+volatile uint8_t scroll_steps;  // steps due, counted by the tick, drawn by display_task
+
+/**
+ * @brief Digit code for a character
+ *
+ * @param c Character
+ * @return uint8_t 4 bit digit code, 0xF (blank) if it has none
+ */
+uint8_t glyph(char c) {
+    if (c >= 'a' && c <= 'z')
+        c -= 'a' - 'A';
+    if (c < 0x20 || c > 0x5F)
+        return 0xF;
+    c -= 0x20;
+    return (c & 1) ? glyph_table[c >> 1] & 0x0F : glyph_table[c >> 1] >> 4;
+}
+
+/**
+ * @brief Put a code on one position of the 16 digit strip
+ *
+ * @param pos Strip position 0-15
+ * @param code 4 bit digit code
+ */
+void text_put(uint8_t pos, uint8_t code) {
+    if (pos < 8)
+        write_money(7 - pos, code);
+    else
+        write_service(15 - pos, code);
+}
+
+/**
+ * @brief Show text on the 16 digit strip
+ *
+ * Writes from pos to the end of the text or of the strip, whichever comes
+ * first; the other digits are left alone.
+ *
+ * @param pos First strip position, 0-7 money display, 8-15 service display
+ * @param text Text to show
+ */
+void display_text(uint8_t pos, const char* text) {
+    while (*text && pos < TEXT_DIGITS)
+        text_put(pos++, glyph(*text++));
+}
+
+/**
+ * @brief Draw the scroll text at the current scroll position
+ */
+void scroll_draw() {
+    uint8_t i = scroll_pos;
+
+    for (uint8_t pos = 0; pos < TEXT_DIGITS; pos++) {
+        text_put(pos, i < scroll_len ? glyph(scroll_text[i]) : 0xF);
+        if (++i == scroll_len + SCROLL_GAP)
+            i = 0;
+    }
+}
+
+/**
+ * @brief Show text on the whole strip, scrolling if it is longer than 16
+ *
+ * The timer tick times the scrolling and display_task draws it, until
+ * display_scroll_stop() or a key press. The text must stay valid meanwhile.
+ *
+ * @param text Text to show
+ */
+void display_scroll(const char* text) {
+    uint8_t len = strlen(text);
+    uint8_t irq = irq_save();
+    scroll_text = 0;
+    scroll_len = len;
+    scroll_pos = 0;
+    scroll_left = SCROLL_PERIOD;
+    scroll_steps = 0;
+    if (len > TEXT_DIGITS)
+        scroll_text = text;
+    irq_restore(irq);
+
+    if (scroll_text) {
+        scroll_draw();
+    } else {
+        for (uint8_t pos = 0; pos < TEXT_DIGITS; pos++)
+            text_put(pos, 0xF);
+        display_text(0, text);
+    }
+}
+
+/**
+ * @brief Stop scrolling, the digits keep the current text
+ */
+void display_scroll_stop() {
+    scroll_text = 0;
+}
+
+/**
+ * @brief Count down to the next scroll step
+ *
+ * Called from the timer 2 tick with interrupts disabled. Only counts the
+ * step, the 16 digits are redrawn by display_scroll_update() outside the
+ * interrupt.
+ */
+void display_scroll_tick() {
+    if (!scroll_text || --scroll_left)
+        return;
+    scroll_left = SCROLL_PERIOD;
+    scroll_steps++;
+}
+
+/**
+ * @brief Draw the scroll steps that came due since the last call
+ *
+ * Called from display_task before refresh_display().
+ */
+void display_scroll_update() {
+    uint8_t irq = irq_save();
+    uint8_t steps = scroll_steps;
+    scroll_steps = 0;
+    irq_restore(irq);
+
+    if (!steps || !scroll_text)
+        return;
+    while (steps--) {
+        if (++scroll_pos == scroll_len + SCROLL_GAP)
+            scroll_pos = 0;
+    }
+    scroll_draw();
+}
+
 /**
  * @brief Initialize the 8279 keyboard/display controller
  *
@@ -416,19 +1012,93 @@ void init_kdc() {
     kdc_cmd_out(I8279_END_INTERRUPT);
 }
 
+/**
+ * @brief Serial baud rates the 8256 can generate on this board
+ *
+ * The low nibble of Command 2 selects the rate from the internal baud clock.
+ * Each step down in the code doubles the rate; code 5 is the 4800 baud that
+ * has always been used, code 2 is the fastest internally generated rate.
+ */
+struct baud_rate_t {
+    uint16_t rate;
+    uint8_t cmd2;
+};
+
+const struct baud_rate_t baud_table[] = {
+    {  2400, I8256_CMD2_SCLK_DIV3 | 6 },
+    {  4800, I8256_CMD2_SCLK_DIV3 | 5 },
+    {  9600, I8256_CMD2_SCLK_DIV3 | 4 },
+    { 19200, I8256_CMD2_SCLK_DIV3 | 3 },
+    { 38400, I8256_CMD2_SCLK_DIV3 | 2 },
+};
+
+#define BAUD_COUNT   (sizeof(baud_table) / sizeof(baud_table[0]))
+#define BAUD_DEFAULT 1      // 4800
+
+uint8_t baud_index = BAUD_DEFAULT;
+
+// Button layouts, see keymaps[]
+enum KEYMAP {
+    KEYMAP_CABINET  = 0,
+    KEYMAP_EMULATOR = 1,    // current mame on master has the risk buttons reversed
+    KEYMAP_COUNT
+};
+#ifdef EMULATOR
+#define KEYMAP_DEFAULT KEYMAP_EMULATOR
+#else
+#define KEYMAP_DEFAULT KEYMAP_CABINET
+#endif
+
+uint8_t keymap_index = KEYMAP_DEFAULT;
+
+/**
+ * @brief Checksum over the settings block
+ */
+uint8_t settings_checksum() {
+    return ~(settings->magic ^ settings->baud ^ settings->keymap);
+}
+
+/**
+ * @brief Pick up the settings left by the last run, or fall back to defaults
+ */
+void settings_load() {
+    if (settings->magic != SETTINGS_MAGIC ||
+        settings->check != settings_checksum() ||
+        settings->baud >= BAUD_COUNT ||
+        settings->keymap >= KEYMAP_COUNT) {
+        settings->baud = BAUD_DEFAULT;
+        settings->keymap = KEYMAP_DEFAULT;
+        settings_save();
+    }
+    baud_index = settings->baud;
+    keymap_index = settings->keymap;
+}
+
+/**
+ * @brief Store the current settings so they survive a reset
+ */
+void settings_save() {
+    settings->magic = SETTINGS_MAGIC;
+    settings->baud = baud_index;
+    settings->keymap = keymap_index;
+    settings->check = settings_checksum();
+}
+
 /**
  * @brief Initialize the 8256 MUART
  * 
- * Configures the MUART for 4800 baud, 8 data bits, 1 stop bit,
- * enables receiver and transmitter, sets port modes, and enables interrupts.
+ * Configures the MUART for the saved baud rate (4800 by default), 8 data
+ * bits, 1 stop bit, enables receiver and transmitter, sets port modes, and
+ * enables interrupts.
  * 
  */
 void init_muart() {
     __asm
         MVI A, I8256_CMD1_FRQ_1K | I8256_CMD1_8085 | I8256_CMD1_STOP_1 | I8256_CMD1_CHARLEN_8
         OUT I8256_CMD1
-        MVI A, I8256_CMD2_SCLK_DIV3 | 5 //4800baud
-        OUT I8256_CMD2
+    __endasm;
+    set_muart_command2(baud_table[baud_index].cmd2);
+    __asm
         MVI A, I8256_CMD3_RESET | I8256_CMD3_IAE | I8256_CMD3_RXE | I8256_CMD3_SET
         OUT I8256_CMD3
         MVI A, I8256_MODE_PORT2C_OO
@@ -444,82 +1114,393 @@ void init_muart() {
         MVI A, 0xBA
         OUT I8256_INTAD
     __endasm;
+    arm_muart_interrupts(I8256_INT_L4);   // receiver, delivered once EI
 }
 
 /**
- * @brief Initialize the 8255 PPI
- * 
+ * @brief Switch the serial link to another rate from baud_table
+ *
+ * Waits for pending output to leave at the old rate first.
+ *
+ * @param index Entry in baud_table
  */
-void init_ppi() {
-    __asm
-        MVI A, 0x80
-        OUT 0x73
-    __endasm;
+void set_baud(uint8_t index) {
+    serial_flush();
+    set_muart_command2(baud_table[index].cmd2);
+    baud_index = index;
 }
 
+// Autobaud: the host streams 'U' (0x55) at the rate it wants. Each candidate
+// rate must receive AUTOBAUD_CHARS clean sync characters, and they must take
+// the time that many 10-bit characters take at that rate on timer 3.
+// The candidates are tried for AUTOBAUD_ROUNDS rounds, so the host has a few
+// seconds to switch. Once the board answers at the new rate, the host stops;
+// the rest of its stream is thrown away until AUTOBAUD_QUIET ms of silence,
+// or AUTOBAUD_DRAIN ms at most.
+#define AUTOBAUD_SYNC   0x55
+#define AUTOBAUD_CHARS  32
+#define AUTOBAUD_ROUNDS 8       // about 1.2 s each
+#define AUTOBAUD_QUIET  30
+#define AUTOBAUD_DRAIN  500
+
 /**
- * @brief Software delay function
+ * @brief Try to lock onto the host's sync stream at one candidate rate
+ *
+ * Polls the receiver directly; level 4 must be masked by the caller.
  *
- * @param ms Number of milliseconds to delay
- * @note Timer 3 works at either 1kHz or 16kHz depending on configuration.
- *       This function assumes a 1kHz timer for millisecond delays.
+ * @param index Entry in baud_table, already programmed into the MUART
+ * @return bool true if the sync stream was received cleanly at this rate
  */
-void delay(uint16_t ms) {
-    uint16_t full_chunks = ms / 255;
-    uint8_t remainder = ms % 255;
+bool autobaud_try(uint8_t index) {
+    // Timer 3 counts at 1.024 kHz; 2400 baud gives ~137 counts, within range
+    uint16_t expect = (uint16_t)((uint32_t)AUTOBAUD_CHARS * 10 * 1024 / baud_table[index].rate);
+    uint8_t good = 0;
+    uint8_t bad = 0;
 
-    // Wait for full 255ms chunks
-    for (uint16_t i = 0; i < full_chunks; i++) {
-        wait_timer3(255);
-    }
-    
-    // Wait for the remaining milliseconds
-    if (remainder > 0) {
-        wait_timer3(remainder);
+    read_buffer();                          // drop whatever the old rate left
+    set_timer3(0xFF);
+    while (read_timer3() > 0x10) {          // ~240 ms per candidate
+        uint8_t status = read_status();
+        if ((status & I8256_STATUS_RBF) == 0)
+            continue;
+
+        uint8_t c = read_buffer();
+        if ((status & (I8256_STATUS_FE | I8256_STATUS_PE | I8256_STATUS_OE)) || c != AUTOBAUD_SYNC) {
+            if (++bad > 4)
+                return false;
+            good = 0;
+            continue;
+        }
+
+        if (good == 0)
+            set_timer3(0xFF);               // time from the first clean sync on
+        if (++good > AUTOBAUD_CHARS) {
+            uint8_t elapsed = 0xFF - read_timer3();
+            uint16_t margin = (expect >> 2) + 1;
+            return elapsed + margin >= expect && elapsed <= expect + margin;
+        }
     }
+    return false;
 }
 
 /**
- * @brief Software delay function
+ * @brief Detect the host's baud rate from a stream of sync characters
  *
- * @param ms Number of milliseconds to delay
- * @note This is a simple busy-wait loop and not very precise
+ * Triggered by the host with the AUTOBAUD command. The handshake:
+ *  1. the board prints "autobaud: send U at the new rate" at the old rate,
+ *  2. the host switches its own rate and sends 'U' until it reads
+ *     "baud <rate>" at the new rate, then stops sending,
+ *  3. the board drops the rest of the stream and listens again.
+ * The detected rate is saved in the settings. If no rate locks within
+ * AUTOBAUD_ROUNDS rounds, the board answers "(autobaud failed)" at the old
+ * rate, where the host has to go back to.
+ *
+ * @return bool true if a rate was found (otherwise the old rate is kept)
  */
-void dumb_delay(uint16_t ms) {
-    uint16_t i;
-    for (i = 0; i < ms; i++) {
-        for (uint8_t j = 0; j < 28; j++) {
-        __asm
-            NOP
-            NOP
-            NOP
-        __endasm
+bool autobaud() {
+    uint8_t old = baud_index;
+    bool found = false;
+
+    print_string("autobaud: send U at the new rate\n");
+    serial_flush();
+    disable_muart_interrupts(I8256_INT_L4);      // poll the receiver directly
+
+    for (uint8_t round = 0; round < AUTOBAUD_ROUNDS && !found; round++) {
+        for (uint8_t i = BAUD_COUNT; i-- > 0 && !found;) {
+            set_muart_command2(baud_table[i].cmd2);
+            if (autobaud_try(i)) {
+                baud_index = i;
+                found = true;
+            }
         }
     }
-}
 
-void wait_tx_ready() {
-    while ((read_status() & I8256_STATUS_TBE) == 0) {
-        dumb_delay(1);
+    if (found) {
+        // Answer at once, the host stops the stream when it reads this
+        print_string("baud "); print_dec(baud_table[baud_index].rate);
+        print_serial_char('\n');
+        uint16_t quiet = millis16() + AUTOBAUD_QUIET;
+        uint16_t end = millis16() + AUTOBAUD_DRAIN;
+        while (!deadline_passed(quiet) && !deadline_passed(end)) {
+            if (read_status() & I8256_STATUS_RBF) {
+                read_buffer();
+                quiet = millis16() + AUTOBAUD_QUIET;
+            }
+        }
+        settings_save();
+    } else {
+        set_muart_command2(baud_table[old].cmd2);
+    }
+
+    read_buffer();
+    arm_muart_interrupts(I8256_INT_L4);
+    if (!found) {
+        print_string("baud "); print_dec(baud_table[baud_index].rate);
+        print_string(" (autobaud failed)\n");
     }
+    return found;
 }
 
 /**
- * @brief Set data to be sent via MUART
- *
- * @param txdata Data to transmit
+ * @brief Initialize the 8255 PPI
+ * 
  */
-void print_serial_char(uint8_t txdata) {
-    wait_tx_ready();
-    write_buffer(txdata);
+void init_ppi() {
+    __asm
+        MVI A, 0x80
+        OUT 0x73
+    __endasm;
 }
 
-uint8_t read_serial_char() {
-    return read_buffer();
+/**
+ * @brief Start the system tick on timer 2
+ *
+ * Must run after init_muart(), which resets all interrupt enables.
+ */
+void init_tick() {
+    set_timer2(TICK_COUNTS);
+    arm_muart_interrupts(I8256_INT_L1);
 }
 
-void print_string(const char* str) {
-    while (*str) {
+/**
+ * @brief Start the display blink on timer 5
+ *
+ * Like init_tick(), this has to come after init_muart().
+ */
+void init_blink() {
+    set_timer5(BLINK_COUNTS);
+    arm_muart_interrupts(I8256_INT_L7);
+}
+
+/**
+ * @brief Milliseconds since the tick was started
+ *
+ * @return uint32_t Milliseconds, wraps after about 49 days
+ * @note The tick stops while interrupts are disabled for longer than 1 ms.
+ */
+uint32_t millis() {
+    uint8_t irq = irq_save();
+    uint32_t now = tick_ms;
+    irq_restore(irq);
+    return now;
+}
+
+/**
+ * @brief Low 16 bits of millis(), cheap enough for loops
+ *
+ * @return uint16_t Milliseconds, wraps every 65.5 s
+ */
+uint16_t millis16() {
+    uint8_t irq = irq_save();
+    uint16_t now = (uint16_t)tick_ms;
+    irq_restore(irq);
+    return now;
+}
+
+/**
+ * @brief Milliseconds since a millis16() timestamp
+ *
+ * @param start Earlier millis16() value
+ * @return uint16_t Elapsed time, correct across wraparound up to 65.5 s
+ */
+uint16_t elapsed_since(uint16_t start) {
+    return millis16() - start;
+}
+
+/**
+ * @brief Check whether a millis16() deadline has been reached
+ *
+ * @param deadline millis16() value to wait for, at most 32.7 s ahead
+ * @return bool true once the deadline is now or in the past
+ */
+bool deadline_passed(uint16_t deadline) {
+    return (int16_t)(millis16() - deadline) >= 0;
+}
+
+/**
+ * @brief Wait until a millis16() deadline
+ *
+ * Waiting on an absolute deadline keeps periodic loops from drifting:
+ * step with deadline += period instead of delaying after the work.
+ *
+ * @param deadline millis16() value to wait for, at most 32.7 s ahead
+ */
+void sleep_until(uint16_t deadline) {
+    while (!deadline_passed(deadline)) {
+    }
+}
+
+/**
+ * @brief Wait a number of milliseconds
+ *
+ * @param ms Number of milliseconds to delay, at most 32767
+ * @note Waits between ms-1 and ms, as the current tick is already running.
+ */
+void delay(uint16_t ms) {
+    sleep_until(millis16() + ms);
+}
+
+/**
+ * @brief Move one queued byte into the MUART by polling
+ *
+ * Fallback for when the transmitter interrupt cannot run (queue full while
+ * interrupts are off, or called from an ISR). Safe to call alongside the ISR.
+ */
+void tx_poll() {
+    uint8_t irq = irq_save();
+    if ((read_status() & I8256_STATUS_TBE) && tx_tail != tx_head) {
+        write_buffer(tx_buf[tx_tail]);
+        tx_tail = (tx_tail + 1) & (TX_BUF_SIZE - 1);
+    }
+    irq_restore(irq);
+}
+
+/**
+ * @brief Start the interrupt-driven transmit chain
+ *
+ * Arms level 5 and, if the transmitter is idle, sends the first queued byte
+ * directly so the next "buffer empty" interrupt keeps the chain going.
+ */
+void tx_kick() {
+    uint8_t irq = irq_save();
+    if (!tx_active) {
+        tx_active = true;
+        arm_muart_interrupts(I8256_INT_L5);
+        if ((read_status() & I8256_STATUS_TBE) && tx_tail != tx_head) {
+            write_buffer(tx_buf[tx_tail]);
+            tx_tail = (tx_tail + 1) & (TX_BUF_SIZE - 1);
+        }
+    }
+    irq_restore(irq);
+}
+
+/**
+ * @brief Queue a byte to be sent via MUART if there is room
+ *
+ * Never blocks, so ISRs can use it too.
+ *
+ * @param txdata Data to transmit
+ * @return bool false if the queue was full
+ */
+bool tx_try_put(uint8_t txdata) {
+    uint8_t irq = irq_save();
+    uint8_t next = (tx_head + 1) & (TX_BUF_SIZE - 1);
+    bool ok = next != tx_tail;
+    if (ok) {
+        tx_buf[tx_head] = txdata;
+        tx_head = next;
+        if (!tx_active)
+            tx_kick();
+    }
+    irq_restore(irq);
+    return ok;
+}
+
+/**
+ * @brief Number of bytes the transmit queue takes without blocking
+ *
+ * @return uint8_t Free slots in tx_buf
+ */
+uint8_t tx_free() {
+    return (uint8_t)(tx_tail - tx_head - 1) & (TX_BUF_SIZE - 1);
+}
+
+/**
+ * @brief Queue data to be sent via MUART
+ *
+ * Returns as soon as the byte is in the transmit queue. Only blocks when the
+ * queue is full, in which case bytes are pushed out by polling until a slot
+ * frees up.
+ *
+ * @param txdata Data to transmit
+ */
+void print_serial_char(uint8_t txdata) {
+    while (!tx_try_put(txdata)) {
+        tx_poll();
+    }
+}
+
+/**
+ * @brief Wait until every queued byte has left the transmitter
+ *
+ * Call at the end of a test (or before a reset or baud change) so nothing
+ * is still sitting in the queue or the shift register.
+ */
+void serial_flush() {
+    while (tx_tail != tx_head) {
+        tx_poll();
+    }
+    while ((read_status() & I8256_STATUS_TRE) == 0) {
+        // wait for the shift register to empty
+    }
+}
+
+/**
+ * @brief Take one byte from the serial receive queue
+ *
+ * @return uint8_t Received byte, only valid if serial_available() was true
+ */
+uint8_t read_serial_char() {
+    uint8_t data = rx_buf[rx_tail];
+    rx_tail = (rx_tail + 1) & (RX_BUF_SIZE - 1);
+    return data;
+}
+
+/**
+ * @brief Check whether the receive queue holds any bytes
+ */
+bool serial_available() {
+    return rx_head != rx_tail;
+}
+
+/**
+ * @brief Assemble a line from the receive queue without blocking
+ *
+ * Consumes whatever has arrived so far, echoing it back, and returns true
+ * once a CR or LF completes a line. The line is assembled in buf, which
+ * must be the same buffer on every call, and is NUL-terminated once
+ * complete; characters beyond len - 1 are dropped. Backspace edits the
+ * line.
+ *
+ * @param buf Line buffer, complete line once this returns true
+ * @param len Size of buf
+ * @return bool true if buf now holds a complete line
+ */
+bool serial_getline(char* buf, uint8_t len) {
+    while (serial_available()) {
+        uint8_t c = read_serial_char();
+
+        // Binary remote-control frames start with STX between lines
+        if (remote_rx_byte(c, rx_line_len == 0))
+            continue;
+
+        if (c == '\r' || c == '\n') {
+            if (rx_line_len == 0)
+                continue;           // swallow the LF of a CR/LF pair
+            print_serial_char('\n');
+            buf[rx_line_len] = 0;
+            rx_line_len = 0;
+            return true;
+        }
+
+        if (c == 0x08 || c == 0x7f) {
+            if (rx_line_len > 0) {
+                rx_line_len--;
+                print_string("\b \b");
+            }
+            continue;
+        }
+
+        if (rx_line_len < len - 1) {
+            buf[rx_line_len++] = c;
+            print_serial_char(c);
+        }
+    }
+    return false;
+}
+
+void print_string(const char* str) {
+    while (*str) {
         print_serial_char(*str);
         str++;
     }
@@ -536,41 +1517,40 @@ void print_hex8(uint8_t v) {
     print_serial_char(hex[v & 0x0F]);
 }
 
-void play_note(uint8_t note, uint8_t octave, uint8_t duration)
-{
-    uint8_t l_notedata = 0;
-    l_notedata |= (note & 0x0F);
-    l_notedata |= ((duration & 0x03) << 4);
-    l_notedata |= ((octave & 0x03) << 6);    
-    set_sound(l_notedata);
-    counter_out(COUNTERS_START_SOUND);
-    dumb_delay(1);
-    counter_out(0);
+/**
+ * @brief Print an unsigned number in decimal over the serial port
+ *
+ * @param v Number to print
+ */
+void print_dec(uint16_t v) {
+    char digits[5];
+    uint8_t n = 0;
+    do {
+        digits[n++] = '0' + (v % 10);
+        v /= 10;
+    } while (v);
+    while (n)
+        print_serial_char(digits[--n]);
 }
 
-void play_track()
-{
-    for (uint16_t i = 0; i < sizeof(track) / sizeof(track[0]); i++)
-    {
-        play_note(track[i].note, track[i].octave, track[i].duration);
-        write_both(0, track[i].note);
-        write_both(1, track[i].octave);
-        write_both(2, track[i].duration);
-        write_both(3, track[i].length);
-        write_both(4, i);
-        refresh_display();
-        // Print lyric to serial port
-        if (track[i].lyric != 0)
-        {
-            const char *lyric = track[i].lyric;
-            print_string(lyric);
-            print_string(" ");
-        }
-
-        dumb_delay(track[i].length * 3);
-    }
+/**
+ * @brief Parse a decimal number from the start of a string
+ *
+ * @param str String starting with digits; parsing stops at the first non-digit
+ * @return uint16_t Parsed value (0 if there are no digits)
+ */
+uint16_t parse_dec(const char* str) {
+    uint16_t v = 0;
+    while (*str >= '0' && *str <= '9')
+        v = v * 10 + (*str++ - '0');
+    return v;
 }
 
+#include "music.c"
+#include "lamps.c"
+#include "reels.c"
+#include "remote.c"
+
 /**
  * @brief Macro to define a button with row, column, and inversion
  *
@@ -605,49 +1585,277 @@ void play_track()
 #define MUENZ      BUTTON(7, 1, 0)
 #define INIT       BUTTON(7, 0, 0)
 
+// Row and bit mask of a button, constants when the button is
+#define BUTTON_ROW(button)  (((button) >> 4) & 0x07)
+#define BUTTON_MASK(button) (1 << ((button) & 0x0F))
+
+// What a button does in the menu, several may be set per button
+enum BUTTON_ACTION {
+    ACT_LEFT    = 0x01,
+    ACT_SELECT  = 0x02,
+    ACT_RIGHT   = 0x04,
+    ACT_RETURN  = 0x08,
+    ACT_CANCEL  = 0x10,     // stops a running test
+    ACT_HW_TEST = 0x20,
+    ACT_DATE    = 0x40,
+    ACT_TIME    = 0x80,
+};
+
 /**
- * @brief Check the state of a button
+ * @brief Where a button sits in the sensor matrix and what it does
  *
- * @param button Button identifier (row, column, and inversion flag)
- * @return bool State of the button (0 or 1)
+ * The row and mask are worked out by the compiler, so looking a button up
+ * costs no shifting at run time.
+ */
+struct button_t {
+    uint8_t row;
+    uint8_t mask;
+    uint8_t actions;    // BUTTON_ACTION bits
+};
+
+#define BUTTON_DESC(button, actions) { BUTTON_ROW(button), BUTTON_MASK(button), actions }
+#define BUTTON_MAP_END               { 0xFF, 0, 0 }
+#define BUTTON_MAP_MAX               12     // entries, including the end marker
+
+const struct button_t keymap_cabinet[] = {
+    BUTTON_DESC(RUNTER01,   ACT_LEFT),
+    BUTTON_DESC(RISK_LEFT,  ACT_LEFT),
+    BUTTON_DESC(GEWINN,     ACT_SELECT),
+    BUTTON_DESC(STOP_MID,   ACT_SELECT),
+    BUTTON_DESC(HOCH1,      ACT_RIGHT),
+    BUTTON_DESC(RISK_RIGHT, ACT_RIGHT),
+    BUTTON_DESC(INIT,       ACT_RETURN | ACT_CANCEL),
+    BUTTON_DESC(RETURN,     ACT_RETURN | ACT_CANCEL),
+    BUTTON_DESC(HW_TEST,    ACT_HW_TEST),
+    BUTTON_DESC(DAUERLAUF,  ACT_DATE),
+    BUTTON_DESC(FOUL,       ACT_TIME),
+    BUTTON_MAP_END
+};
+
+// The risk buttons are left out, current mame has them reversed
+const struct button_t keymap_emulator[] = {
+    BUTTON_DESC(RUNTER01,   ACT_LEFT),
+    BUTTON_DESC(GEWINN,     ACT_SELECT),
+    BUTTON_DESC(HOCH1,      ACT_RIGHT),
+    BUTTON_DESC(INIT,       ACT_RETURN | ACT_CANCEL),
+    BUTTON_DESC(RETURN,     ACT_CANCEL),
+    BUTTON_DESC(HW_TEST,    ACT_HW_TEST),
+    BUTTON_DESC(DAUERLAUF,  ACT_DATE),
+    BUTTON_DESC(FOUL,       ACT_TIME),
+    BUTTON_MAP_END
+};
+
+// Same order as enum KEYMAP
+const struct button_t* const keymaps[KEYMAP_COUNT] = {
+    keymap_cabinet,
+    keymap_emulator,
+};
+
+const char* const keymap_names[KEYMAP_COUNT] = {
+    "CABINET",
+    "EMULATOR",
+};
+
+// A long press switches to the other keymap. The key is matched by its sensor
+// position, so it works whichever keymap is active, and only after
+// calibration, so its wiring polarity does not matter.
+#define KEYMAP_KEY SPIELZ
+
+// The active map, copied from keymaps[] by keymap_set()
+struct button_t button_map[BUTTON_MAP_MAX];
+
+/**
+ * @brief Make one of the keymaps the active button map
+ *
+ * @param index KEYMAP
+ */
+void keymap_set(uint8_t index) {
+    const struct button_t* src = keymaps[index];
+    uint8_t n = 0;
+
+    while (src[n].row != 0xFF && n < BUTTON_MAP_MAX - 1)
+        n++;
+    memcpy(button_map, src, n * sizeof(struct button_t));
+    button_map[n].row = 0xFF;
+    keymap_index = index;
+}
+
+/**
+ * @brief Print the name of the active keymap
+ */
+void keymap_print() {
+    print_string("keymap ");
+    print_string(keymap_names[keymap_index]);
+    print_serial_char('\n');
+}
+
+/**
+ * @brief Switch to the next keymap and save the choice
+ */
+void keymap_next() {
+    keymap_set((keymap_index + 1) % KEYMAP_COUNT);
+    settings_save();
+    keymap_print();
+}
+
+/**
+ * @brief Look up what a button does, in one pass over button_map
+ *
+ * @param row Sensor row of the button
+ * @param mask Its bit in that row, or several bits to look up at once
+ * @return uint8_t BUTTON_ACTION bits of every matching button
  */
-bool check_button(uint8_t button) {
-    uint8_t row = (button >> 4) & 0x07;
-    uint8_t mask = 1 << (button & 0x0F);
+uint8_t button_actions(uint8_t row, uint8_t mask) {
+    uint8_t actions = 0;
 
-    // Pressed = debounced state deviates from the boot baseline.
-    // Polarity is handled by calibration, so the inverted bit is ignored.
-    return ((sensor_debounced[row] ^ sensor_baseline[row]) & mask) != 0;
+    for (const struct button_t* b = button_map; b->row != 0xFF; b++) {
+        if (b->row == row && (b->mask & mask))
+            actions |= b->actions;
+    }
+    return actions;
+}
+
+/**
+ * @brief Check whether any button with one of the given actions is held
+ *
+ * @param actions BUTTON_ACTION bits
+ * @return bool true if one of those buttons is pressed right now
+ */
+bool buttons_held(uint8_t actions) {
+    for (const struct button_t* b = button_map; b->row != 0xFF; b++) {
+        if ((b->actions & actions)
+                && ((sensor_debounced[b->row] ^ sensor_baseline[b->row]) & b->mask))
+            return true;
+    }
+    return false;
 }
 
 /**
- * @brief Check whether a button was just pressed (rising edge)
+ * @brief Check the state of a button
  *
- * Returns true for one scan only, on the transition from released to pressed.
- * Use this for menu navigation so a single physical press = a single step.
+ * A macro, so the row and mask of a named button are constants.
+ * Pressed = debounced state deviates from the boot baseline.
+ * Polarity is handled by calibration, so the inverted bit is ignored.
  *
  * @param button Button identifier (row, column, and inversion flag)
- * @return bool true on the scan where the button became pressed
  */
-bool check_button_edge(uint8_t button) {
-    uint8_t row = (button >> 4) & 0x07;
-    uint8_t mask = 1 << (button & 0x0F);
+#define check_button(button) \
+    (((sensor_debounced[BUTTON_ROW(button)] ^ sensor_baseline[BUTTON_ROW(button)]) \
+      & BUTTON_MASK(button)) != 0)
+
+// Key event queue. KEY_QUEUE_SIZE must be a power of two.
+#define KEY_NONE       0xFF        // key_held_row when nothing is held
+struct key_event_t key_queue[KEY_QUEUE_SIZE];
+uint8_t key_head = 0;
+uint8_t key_tail = 0;
+
+uint8_t key_repeat_mask[8];         // buttons that auto-repeat, bit n = column n
+uint16_t key_repeat_delay = 500;    // ms from the press to the first repeat
+uint16_t key_repeat_rate = 150;     // ms between repeats
+uint16_t key_long_time = 1000;      // ms held until KEY_LONG
+
+uint8_t key_held_row = KEY_NONE;    // last button pressed, while it is held
+uint8_t key_held_mask;
+uint16_t key_held_since;
+uint16_t key_next_repeat;
+bool key_long_sent;
+
+/**
+ * @brief Queue a key event, stamped with the current time
+ *
+ * A press also makes the button the one that repeats and long-presses.
+ *
+ * @param row Sensor row of the button
+ * @param mask Its bit in that row
+ * @param type KEY_EVENT
+ * @return bool false if the queue was full and the event was dropped
+ */
+bool key_post(uint8_t row, uint8_t mask, uint8_t type) {
+    uint8_t next = (key_head + 1) & (KEY_QUEUE_SIZE - 1);
+    uint16_t now = millis16();
+
+    if (type == KEY_PRESS) {
+        key_held_row = row;
+        key_held_mask = mask;
+        key_held_since = now;
+        key_next_repeat = now + key_repeat_delay;
+        key_long_sent = false;
+    } else if (type == KEY_RELEASE && row == key_held_row && mask == key_held_mask) {
+        key_held_row = KEY_NONE;
+    }
 
-    return (button_edge[row] & mask) != 0;
+    if (next == key_tail)
+        return false;
+    key_queue[key_head].row = row;
+    key_queue[key_head].mask = mask;
+    key_queue[key_head].type = type;
+    key_queue[key_head].time = now;
+    key_head = next;
+    return true;
 }
 
 /**
- * @brief Poll the return button so long-running tests can be cancelled
+ * @brief Take the oldest key event from the queue
  *
- * Rescans the button matrix and reports a fresh press of the return / INIT
- * button. Call this inside any blocking loop in a self-test so the user can
- * always bail out instead of having to power-cycle.
+ * @param ev Filled with the event
+ * @return bool false if the queue is empty
+ */
+bool key_get(struct key_event_t* ev) {
+    if (key_tail == key_head)
+        return false;
+    *ev = key_queue[key_tail];
+    key_tail = (key_tail + 1) & (KEY_QUEUE_SIZE - 1);
+    return true;
+}
+
+/**
+ * @brief Queue the repeat and long-press events of the held button
  *
- * @return bool true if the user just pressed return
+ * Call this on every scan, the held button's row does not change while it
+ * is held so scan_buttons() does not look at it.
  */
-bool test_cancelled() {
-    scan_buttons();
-    return check_button_edge(INIT) || check_button_edge(RETURN);
+void key_timers() {
+    uint8_t row = key_held_row;
+
+    if (row == KEY_NONE)
+        return;
+    if (!key_long_sent && elapsed_since(key_held_since) >= key_long_time) {
+        key_long_sent = true;
+        key_post(row, key_held_mask, KEY_LONG);
+    }
+    if ((key_repeat_mask[row] & key_held_mask) && deadline_passed(key_next_repeat)) {
+        key_next_repeat += key_repeat_rate;
+        key_post(row, key_held_mask, KEY_REPEAT);
+    }
+}
+
+/**
+ * @brief Turn auto-repeat on or off for a button
+ *
+ * @param button Button identifier
+ * @param on true to repeat while held
+ */
+void key_set_repeat(uint8_t button, bool on) {
+    uint8_t row = BUTTON_ROW(button);
+    uint8_t mask = BUTTON_MASK(button);
+
+    if (on)
+        key_repeat_mask[row] |= mask;
+    else
+        key_repeat_mask[row] &= ~mask;
+}
+
+/**
+ * @brief Set the auto-repeat and long-press times
+ *
+ * @param repeat_delay ms from the press to the first repeat
+ * @param repeat_rate ms between repeats
+ * @param long_time ms held until KEY_LONG
+ */
+void key_set_timing(uint16_t repeat_delay, uint16_t repeat_rate, uint16_t long_time) {
+    key_repeat_delay = repeat_delay;
+    key_repeat_rate = repeat_rate;
+    key_long_time = long_time;
 }
 
 void display_rtc_date()
@@ -721,12 +1929,10 @@ void handle_date_edit_mode(bool buttonl, bool buttons, bool buttonr, bool button
         navigate_digit_next();
         display_rtc_date();
         refresh_display();
-        dumb_delay(200);
     } else if (buttonr) {
         navigate_digit_prev();
         display_rtc_date();
         refresh_display();
-        dumb_delay(200);
     }
 
     if (buttons) {
@@ -740,7 +1946,6 @@ void handle_date_edit_mode(bool buttonl, bool buttons, bool buttonr, bool button
         }
         display_rtc_date();
         refresh_display();
-        dumb_delay(200);
     }
 
     if (buttonret) {
@@ -770,12 +1975,10 @@ void handle_time_edit_mode(bool buttonl, bool buttons, bool buttonr, bool button
         navigate_digit_next();
         display_rtc_time();
         refresh_display();
-        dumb_delay(200);
     } else if (buttonr) {
         navigate_digit_prev();
         display_rtc_time();
         refresh_display();
-        dumb_delay(200);
     }
 
     if (buttons) {
@@ -789,7 +1992,6 @@ void handle_time_edit_mode(bool buttonl, bool buttons, bool buttonr, bool button
         }
         display_rtc_time();
         refresh_display();
-        dumb_delay(200);
     }
 
     if (buttonret) {
@@ -851,23 +2053,26 @@ void menu_edit_time() {
     refresh_display();
 }
 
-/**
- * @brief Menu option: Play music track
- */
-void menu_play_music() {
-    play_track();
-}
-
 /**
  * @brief Menu option: Lamp test pattern
+ *
+ * Chases through every lamp, then shows all lamps at each brightness.
  */
-void menu_lamp_test() {
-    for (uint8_t j = 0; j < 16; j++) {
-        for (uint8_t k = 0; k < 8; k++) {
-            write_lamps(j, 1 << k);
-            dumb_delay(200);
-        }
+uint8_t menu_lamp_test(struct task_t* t) {
+    static uint8_t level, row;
+
+    PT_BEGIN(t);
+    menu_clear_lamps();
+    lamp_play(lamp_seq_chase, false);
+    PT_WAIT_UNTIL(t, !lamp_playing());
+
+    // every lamp at each brightness, dimmest first
+    for (level = 1; level <= 3; level++) {
+        for (row = 0; row < 8; row++)
+            lamp_set_level(row, 0xFF, level);
+        PT_SLEEP(t, 1000);
     }
+    PT_END(t);
 }
 
 /**
@@ -880,29 +2085,14 @@ void menu_all_lamps_on() {
 }
 
 /**
- * @brief Menu option: 8256 MUART timer self-test
- *
- * Exercises Timer 3 of the 8256 in three ways and reports over the serial
- * port (and on the 7-segment display):
- *   1. Read-back: the timer must be readable and counting down.
- *   2. Frequency: counts per RTC second, expected ~0x400 (1.024 kHz mode).
- *   3. Interrupt: the Level 3 timer interrupt must fire (bounded by the RTC
- *      so this can never hang, unlike a bare wait_timer3).
+ * @brief 8256 parallel I/O check, first part of menu_8256_test()
  *
- * The display shows "8256" then the measured counts/second as 4 hex digits.
+ * Drive both ports fully as outputs and zero them, then flip both ports
+ * to inputs and read them back. The read-back state is shown on the lamps
+ * (Port 1 on lamp line 0, Port 2 on lamp line 1) and logged over serial.
  */
-void menu_8256_test() {
-    // Label "8256" on the displays
-    write_both(7, 8); write_both(6, 2); write_both(5, 5); write_both(4, 6);
-    write_both(3, 0); write_both(2, 0); write_both(1, 0); write_both(0, 0);
-    refresh_display();
-
-    print_string("\n8256 timer test\n");
-
-    // --- Parallel I/O test (before the timer tests) ---
-    // Drive both ports fully as outputs and zero them, then flip both ports
-    // to inputs and read them back. The read-back state is shown on the lamps
-    // (Port 1 on lamp line 0, Port 2 on lamp line 1) and logged over serial.
+void muart_port_test() {
+    reels_release();                         // keep the reel engine off Port 2
     set_port1_control(0x00);                 // Port 1: all pins outputs
     set_muart_mode(I8256_MODE_PORT2C_OO);    // Port 2: both nibbles outputs
     set_port1(0x00);                         // zero the outputs
@@ -922,17 +2112,79 @@ void menu_8256_test() {
     // Restore the normal MUART port configuration for the rest of the ROM
     set_muart_mode(I8256_MODE_PORT2C_OO);
     set_port1_control(0x70);
-    set_port2(0xFF);
+    reels_release();                         // Port 2 idle, engine back in step
+    reel_homed = 0;                          // the test patterns may have moved any reel
     set_port1(0x30);
+}
+
+/**
+ * @brief Check that timer 3 raises its interrupt request (polled, cannot hang)
+ *
+ * We deliberately do NOT enable 8085 interrupt delivery here. Enabling the
+ * timer-3 interrupt and relying on the ISR can storm the CPU if the MUART's
+ * interrupt request is never acknowledged, which starves the main loop and
+ * hangs the whole ROM regardless of any RTC bound. Instead we arm L3 in the
+ * MUART mask only (no EI) and poll the status INT bit, so a broken interrupt
+ * path reports FAIL instead of hanging. The system tick and all tasks pause
+ * meanwhile, for about 200 ms on a working chip.
+ *
+ * The tick (L1), receiver (L4), transmitter (L5) and blink (L7) levels are
+ * armed in normal operation and would raise INT by themselves within a
+ * millisecond, so they are masked for the poll and armed again afterwards.
+ *
+ * @return bool true if the interrupt request showed up
+ */
+bool muart_l3_fires() {
+    disable_interrupts();                    // no 8085 vectoring while we poll
+    disable_muart_interrupts(I8256_INT_L1 | I8256_INT_L4 | I8256_INT_L5 | I8256_INT_L7);
+    arm_muart_interrupts(I8256_INT_L3);      // enable L3 in MUART mask, no EI
+    set_timer3(200);                         // ~200 ms at 1.024 kHz
+    uint8_t prev = rtc_get_seconds();
+    uint8_t ticks = 0;
+    bool int_ok = false;
+    while (ticks < 2) {                      // give it up to ~2 RTC seconds
+        if (read_status() & I8256_STATUS_INT) { int_ok = true; break; }
+        uint8_t cur = rtc_get_seconds();
+        if (cur != prev) { prev = cur; ticks++; }
+    }
+    disable_muart_interrupts(I8256_INT_L3);  // mask L3 again
+    arm_muart_interrupts(I8256_INT_L1 | I8256_INT_L4 | I8256_INT_L7 | (tx_active ? I8256_INT_L5 : 0));
+    enable_interrupts();                     // restore 8085 delivery for the other ISRs
+    return int_ok;
+}
+
+/**
+ * @brief Menu option: 8256 MUART timer self-test
+ *
+ * Exercises Timer 3 of the 8256 in three ways and reports over the serial
+ * port (and on the 7-segment display):
+ *   1. Read-back: the timer must be readable and counting down.
+ *   2. Frequency: counts per RTC second, expected ~0x400 (1.024 kHz mode).
+ *   3. Interrupt: the Level 3 timer interrupt must fire (bounded by the RTC
+ *      so this can never hang).
+ *
+ * The display shows "8256" then the measured counts/second as 4 hex digits.
+ */
+uint8_t menu_8256_test(struct task_t* t) {
+    static uint8_t t0, t1, t2, s, last, now;
+    static uint16_t counts;
+    static bool count_ok, freq_ok, int_ok;
+
+    PT_BEGIN(t);
+
+    print_string("\n8256 timer test\n");
+
+    // --- Parallel I/O test (before the timer tests) ---
+    muart_port_test();
 
     // --- Test 1: timer is readable and counting down ---
     set_timer3(0xFF);
-    uint8_t t0 = read_timer3();
-    dumb_delay(30);
-    uint8_t t1 = read_timer3();
-    dumb_delay(30);
-    uint8_t t2 = read_timer3();
-    bool count_ok = ((uint8_t)(t0 - t1) != 0) && ((uint8_t)(t1 - t2) != 0);
+    t0 = read_timer3();
+    PT_SLEEP(t, 30);
+    t1 = read_timer3();
+    PT_SLEEP(t, 30);
+    t2 = read_timer3();
+    count_ok = ((uint8_t)(t0 - t1) != 0) && ((uint8_t)(t1 - t2) != 0);
 
     print_string("readback ");
     print_hex8(t0); print_serial_char(' ');
@@ -941,26 +2193,24 @@ void menu_8256_test() {
     print_string(count_ok ? "  countdown OK\n" : "  countdown FAIL\n");
 
     // --- Test 2: frequency vs RTC (counts per 1 second) ---
-    uint8_t s = rtc_get_seconds();
-    while (rtc_get_seconds() == s) {      // sync to a second edge
-        if (test_cancelled()) { print_string("cancelled\n"); return; }
-    }
+    s = rtc_get_seconds();
+    PT_WAIT_UNTIL(t, rtc_get_seconds() != s);   // sync to a second edge
     s = rtc_get_seconds();
 
     set_timer3(0xFF);
-    uint8_t last = read_timer3();
-    uint16_t counts = 0;
+    last = read_timer3();
+    counts = 0;
     while (rtc_get_seconds() == s) {
-        uint8_t now = read_timer3();
+        now = read_timer3();
         counts += (uint8_t)(last - now);     // 8-bit modular: handles wrap
         if (now < 0x10) {                    // keep it running (one-shot or auto-reload)
             set_timer3(0xFF);
             now = 0xFF;
         }
         last = now;
-        if (test_cancelled()) { print_string("cancelled\n"); return; }
+        PT_YIELD(t);                         // other tasks take far less than 0xF0 counts
     }
-    bool freq_ok = (counts > 0x320) && (counts < 0x500);  // ~0x400 +/- margin
+    freq_ok = (counts > 0x320) && (counts < 0x500);  // ~0x400 +/- margin
 
     print_string("freq ~");
     print_hex8(counts >> 8); print_hex8(counts & 0xFF);
@@ -972,60 +2222,32 @@ void menu_8256_test() {
     write_both(2, (counts >>  8) & 0x0F);
     write_both(1, (counts >>  4) & 0x0F);
     write_both(0,  counts        & 0x0F);
-    refresh_display();
 
-    // --- Test 3: timer raises its interrupt request (polled, cannot hang) ---
-    // We deliberately do NOT enable 8085 interrupt delivery here. Enabling the
-    // timer-3 interrupt and relying on the ISR (as wait_timer3 does) can storm
-    // the CPU if the MUART's interrupt request is never acknowledged, which
-    // starves the main loop and hangs the whole ROM regardless of any RTC
-    // bound. Instead we arm L3 in the MUART mask only (no EI) and poll the
-    // status INT bit, so a broken interrupt path reports FAIL instead of
-    // hanging.
-    disable_interrupts();                    // no 8085 vectoring while we poll
-    arm_muart_interrupts(I8256_INT_L3);      // enable L3 in MUART mask, no EI
-    set_timer3(200);                         // ~200 ms at 1.024 kHz
-    uint8_t prev = rtc_get_seconds();
-    uint8_t ticks = 0;
-    bool int_ok = false;
-    while (ticks < 2) {                      // give it up to ~2 RTC seconds
-        if (read_status() & I8256_STATUS_INT) { int_ok = true; break; }
-        if (test_cancelled()) {
-            arm_muart_interrupts(0x00);      // clean up before bailing out
-            enable_interrupts();
-            print_string("cancelled\n");
-            return;
-        }
-        uint8_t cur = rtc_get_seconds();
-        if (cur != prev) { prev = cur; ticks++; }
-    }
-    arm_muart_interrupts(0x00);              // mask all MUART ints (clears pending delivery)
-    enable_interrupts();                     // restore 8085 delivery for the other ISRs
+    // --- Test 3: timer raises its interrupt request ---
+    int_ok = muart_l3_fires();
     print_string(int_ok ? "interrupt OK\n" : "interrupt FAIL\n");
 
-    print_string((count_ok && freq_ok && int_ok) ? "8256 PASS\n" : "8256 FAIL\n");
+    test_verdict = (count_ok && freq_ok && int_ok) ? RESULT_PASS : RESULT_FAIL;
+    print_string(test_verdict == RESULT_PASS ? "8256 PASS\n" : "8256 FAIL\n");
 
-    // Hold the result on the display, but let return cut it short
-    for (uint16_t i = 0; i < 3000 && !test_cancelled(); i++) {
-        dumb_delay(1);
-    }
+    // Hold the result on the display, return cancels
+    PT_SLEEP(t, 3000);
+    PT_END(t);
 }
 
 /**
- * @brief Menu option: 8279 display-RAM self-test
+ * @brief Pattern test of the 8279 display RAM, see menu_8279_test()
  *
- * Saves the 16 bytes of display RAM, then writes several patterns (including
- * an address-unique pattern that catches stuck address lines) and reads them
- * back, plus an auto-increment burst. The original contents are restored and
- * the result is reported over serial and on the display. Cancelable with the
- * return button.
+ * Runs without yielding, so no other task touches the display meanwhile,
+ * and holds off the sensor interrupt for the whole check.
+ *
+ * @return bool true if every cell read back what was written
  */
-void menu_8279_test() {
-    print_string("\n8279 display RAM test\n");
-
+bool kdc_ram_check() {
     // Preserve the current display RAM so the test is non-destructive
     uint8_t saved[16];
-    for (uint8_t a = 0; a < 16; a++) saved[a] = read_dram(a);
+    kdc_lock();
+    kdc_read_dram(0, saved, 16);
 
     bool ok = true;
     static const uint8_t patterns[4] = { 0x00, 0xFF, 0xAA, 0x55 };
@@ -1043,12 +2265,6 @@ void menu_8279_test() {
                 print_serial_char('\n');
             }
         }
-        if (test_cancelled()) {
-            for (uint8_t a = 0; a < 16; a++) write_dram(a, saved[a]);
-            refresh_display();
-            print_string("cancelled\n");
-            return;
-        }
     }
 
     // Auto-increment write: one command, 16 sequential data writes
@@ -1059,15 +2275,31 @@ void menu_8279_test() {
     }
 
     // Restore the display
-    for (uint8_t a = 0; a < 16; a++) write_dram(a, saved[a]);
-    refresh_display();
+    kdc_write_dram(0, saved, 16);
+    kdc_unlock();
+    return ok;
+}
 
-    print_string(ok ? "8279 PASS\n" : "8279 FAIL\n");
-    for (uint16_t i = 0; i < 2000 && !test_cancelled(); i++) dumb_delay(1);
+/**
+ * @brief Menu option: 8279 display-RAM self-test
+ *
+ * Saves the 16 bytes of display RAM, then writes several patterns (including
+ * an address-unique pattern that catches stuck address lines) and reads them
+ * back, plus an auto-increment burst. The original contents are restored and
+ * the result is reported over serial and on the display. Cancelable with the
+ * return button.
+ */
+uint8_t menu_8279_test(struct task_t* t) {
+    PT_BEGIN(t);
+    print_string("\n8279 display RAM test\n");
+    test_verdict = kdc_ram_check() ? RESULT_PASS : RESULT_FAIL;
+    print_string(test_verdict == RESULT_PASS ? "8279 PASS\n" : "8279 FAIL\n");
+    PT_SLEEP(t, 2000);
+    PT_END(t);
 }
 
 /**
- * @brief Menu option: RAM size / end detection
+ * @brief Find the top of RAM, see menu_ram_test()
  *
  * Probes upward from RAM_BASE in 256-byte steps. Each probe is non-destructive
  * (save, write 0xA5, read back, restore) and guarded by DI so an interrupt
@@ -1076,12 +2308,9 @@ void menu_8279_test() {
  * real RAM has wrapped and we stop. Probes inside the live stack window are
  * skipped (assumed present) so the scan never corrupts its own frame.
  *
- * The detected top address and size are shown over serial and the size in KB
- * is shown on the display. Cancelable with the return button.
+ * @return uint16_t Highest probe address that is RAM
  */
-void menu_ram_test() {
-    print_string("\nRAM size test\n");
-
+uint16_t ram_probe_top() {
     volatile uint8_t* base = (volatile uint8_t*)RAM_BASE;
 
     disable_interrupts();
@@ -1110,14 +2339,20 @@ void menu_ram_test() {
 
         if (rd != 0xA5 || alias) break;   // not RAM, or mirror of low RAM
         top = addr;
-
-        if (test_cancelled()) { print_string("cancelled\n"); break; }
     }
 
     disable_interrupts();
     base[0] = base_save;
     enable_interrupts();
+    return top;
+}
 
+/**
+ * @brief Show the RAM size found by ram_probe_top()
+ *
+ * @param top Highest probe address that is RAM
+ */
+void ram_report(uint16_t top) {
     uint16_t size = (top - RAM_BASE) + 0x100;   // rounded to the probe step
     uint8_t kb = (uint8_t)(size >> 10);
 
@@ -1127,11 +2362,22 @@ void menu_ram_test() {
     print_string(" ("); print_hex8(kb); print_string(" KB)\n");
 
     // Show the size in KB on the display (low two hex digits)
-    write_both(7, 0x4); write_both(6, 0xa);   // crude "rA" label
     write_both(1, (kb >> 4) & 0x0F);
     write_both(0, kb & 0x0F);
-    refresh_display();
-    for (uint16_t i = 0; i < 2000 && !test_cancelled(); i++) dumb_delay(1);
+}
+
+/**
+ * @brief Menu option: RAM size / end detection
+ *
+ * The top address and size are shown over serial and the size in KB is
+ * shown on the display.
+ */
+uint8_t menu_ram_test(struct task_t* t) {
+    PT_BEGIN(t);
+    print_string("\nRAM size test\n");
+    ram_report(ram_probe_top());
+    PT_SLEEP(t, 2000);
+    PT_END(t);
 }
 
 /**
@@ -1142,27 +2388,127 @@ void menu_ram_test() {
  * FAIL instead of hanging. The 8256 timer tests rely on the RTC advancing, so
  * this isolates "is the RTC alive" from "is the timer alive". Cancelable.
  */
-void menu_rtc_test() {
+uint8_t menu_rtc_test(struct task_t* t) {
+    static uint8_t s0, s1;
+    static uint16_t start;
+
+    PT_BEGIN(t);
     print_string("\nRTC seconds-advance test\n");
 
-    uint8_t s0 = rtc_get_seconds();
-    bool ok = false;
-    for (uint16_t i = 0; i < 1000; i++) {        // ~several seconds worst case
-        if (rtc_get_seconds() != s0) { ok = true; break; }
-        if (test_cancelled()) { print_string("cancelled\n"); return; }
-        dumb_delay(30);
-    }
-    uint8_t s1 = rtc_get_seconds();
+    s0 = rtc_get_seconds();
+    start = millis16();
+    // a live RTC ticks within 1 s
+    PT_WAIT_UNTIL(t, rtc_get_seconds() != s0 || elapsed_since(start) >= 3000);
+    s1 = rtc_get_seconds();
 
     print_string("seconds "); print_hex8(s0);
     print_string(" -> "); print_hex8(s1);
     print_serial_char('\n');
-    print_string(ok ? "RTC PASS\n" : "RTC FAIL\n");
+    test_verdict = (s1 != s0) ? RESULT_PASS : RESULT_FAIL;
+    print_string(test_verdict == RESULT_PASS ? "RTC PASS\n" : "RTC FAIL\n");
 
     write_both(1, (s1 >> 4) & 0x0F);
     write_both(0, s1 & 0x0F);
-    refresh_display();
-    for (uint16_t i = 0; i < 2000 && !test_cancelled(); i++) dumb_delay(1);
+    PT_SLEEP(t, 2000);
+    PT_END(t);
+}
+
+static uint8_t disc_packed[REEL_COUNT][DISC_STEPS / 8];
+bool disc_parallel = true;      // step all wheels at once, else one after the other
+
+/**
+ * @brief Print the header line for one wheel of the disc readout
+ *
+ * @param w Wheel 0..2
+ */
+void disc_wheel_header(uint8_t w) {
+    uint8_t shift = (uint8_t)(w * 2);
+
+    print_string("\nWHEEL ");
+    print_serial_char((char)('1' + w));
+    print_string(" (P2 ");
+    print_serial_char((char)('0' + shift));
+    print_serial_char('/');
+    print_serial_char((char)('0' + shift + 1));
+    print_string(", optic P1.");
+    print_serial_char((char)('0' + w));
+    print_string(")\n");
+}
+
+/**
+ * @brief Print the optic samples of one wheel, one revolution per line
+ *
+ * @param bits Samples as recorded by reel_capture()
+ * @param rev Steps per revolution
+ */
+void disc_print(const uint8_t* bits, uint8_t rev) {
+    for (uint16_t step = 0; step < DISC_STEPS; step++) {
+        print_serial_char((bits[step >> 3] & (1 << (step & 7))) ? '#' : '.');
+        if ((step % rev) == rev - 1)
+            print_serial_char('\n');
+    }
+}
+
+/**
+ * @brief Start recording and stepping a group of wheels in the same tick
+ *
+ * @param first First wheel
+ * @param last One past the last wheel
+ */
+void disc_start(uint8_t first, uint8_t last) {
+    uint8_t irq = irq_save();
+    for (uint8_t w = first; w < last; w++) {
+        memset(disc_packed[w], 0, sizeof(disc_packed[w]));
+        reel_set_speed(w, 10);
+        reel_capture(w, disc_packed[w]);
+        reel_move(w, DISC_STEPS);
+    }
+    irq_restore(irq);
+}
+
+/**
+ * @brief Send or print the readout of one wheel and take its signature
+ *
+ * @param w Wheel 0..2
+ * @return bool true if the signature was taken, see reel_learn()
+ */
+bool disc_report(uint8_t w) {
+    uint8_t head[4];
+
+    disc_wheel_header(w);
+    reel_set_speed(w, 4);
+    if (capture_binary) {
+        head[0] = w;
+        head[1] = (uint8_t)(DISC_STEPS & 0xFF);
+        head[2] = (uint8_t)(DISC_STEPS >> 8);
+        head[3] = REEL_STEPS_REV;
+        remote_block(REMOTE_BLOCK_DISC, head, 4, disc_packed[w], sizeof(disc_packed[w]));
+    } else {
+        disc_print(disc_packed[w], REEL_STEPS_REV);
+    }
+    return reel_learn(w, disc_packed[w], DISC_STEPS);
+}
+
+/**
+ * @brief Print the outcome of learning one wheel
+ *
+ * @param w Wheel 0..2
+ */
+void disc_print_window(uint8_t w) {
+    if (reel_window[w]) {
+        print_string("signature, window ");
+        print_dec(reel_window[w]);
+    } else {
+        print_string("no signature");
+    }
+    print_serial_char('\n');
+}
+
+/**
+ * @brief Stop the reels and idle the coils, stop function of menu_disc_readout()
+ */
+void disc_stop() {
+    reels_release();
 }
 
 /**
@@ -1174,66 +2520,174 @@ void menu_rtc_test() {
  * widths around each disc encode the symbol positions - which is exactly the
  * data MAME is missing to emulate the discs.
  *
- * This walks each of the 3 wheels one motor step at a time through several
- * revolutions, sampling its light barrier after the rotor settles, and prints
- * the optic state per step over the serial port ('#' = light/slot, '.' = dark),
- * 48 steps per line (one revolution as the firmware counts them). Capture the
- * serial log from a working machine to recover the disc map.
+ * This walks the 3 wheels one motor step at a time through several
+ * revolutions, sampling each light barrier after the rotor settles, and
+ * prints the optic state per step over the serial port ('#' = light/slot,
+ * '.' = dark), one revolution (48 steps) per line. Capture the serial log
+ * from a working machine to recover the disc map.
+ *
+ * By default all three wheels step together in one pass, a third of the
+ * time; one read of Port 1 per tick serves all three optics. "DISC ONE"
+ * walks them one after the other instead, e.g. for a weak supply.
  *
  * Wiring (wheel w = 0..2): coils on P2 bits (2w, 2w+1), optic on P1 bit w.
- * Port 1 bits 0-3 are already inputs (PORT1C = 0x70 set in init_muart) and the
- * coil drive uses the firmware's 2-bit gray sequence 0,1,3,2.
+ * Port 1 bits 0-3 are already inputs (PORT1C = 0x70 set in init_muart). The
+ * reel engine in reels.c does the stepping and records the optic before each
+ * step; the samples are printed once the wheels have stopped.
+ *
+ * The first revolution of every wheel becomes its signature (reel_learn),
+ * so the reels can be homed and positioned afterwards; the length of the
+ * shortest unique optic window is printed per wheel.
  *
- * @note Stepping is a constant ~10 ms/step (within the firmware's dwell range,
- *       so the motor follows reliably). Cancelable with the return/INIT button.
+ * In binary mode (capture_binary) the samples are packed 8 steps per byte and
+ * each wheel is sent as one REMOTE_BLOCK_DISC frame; capture.py turns that
+ * back into the text format above.
+ *
+ * @note The reel is held at the slow end of the ramp, ~10 ms/step (within the
+ *       firmware's dwell range, so the optic settles between steps).
+ *       Cancelable with the return/INIT button.
  */
-void menu_disc_readout() {
-    static const uint8_t gray[4] = { 0, 1, 3, 2 };
-    const uint16_t STEPS = 240;   // ~5 revolutions at 48 steps/rev
+uint8_t menu_disc_readout(struct task_t* t) {
+    static uint8_t w, first, last;
+    static uint8_t i, longest;
+
+    PT_BEGIN(t);
+    print_string("\nDISC optic readout  (# = light, . = dark, 1 rev/line)\n");
+
+    for (first = 0; first < REEL_COUNT; first = last) {
+        last = disc_parallel ? REEL_COUNT : first + 1;
+        write_both(0, (uint8_t)(first + 1));   // show current wheel on display
+
+        disc_start(first, last);
+        PT_WAIT_UNTIL(t, !reel_busy(0) && !reel_busy(1) && !reel_busy(2));
+        reels_release();             // idle the coils between wheels
+        for (w = first; w < last; w++) {
+            if (disc_report(w)) {
+                // one start position per pass, the full search is too long to block
+                longest = 0;
+                for (i = 0; i + 1 < REEL_STEPS_REV && longest != REEL_REPEATS; i++) {
+                    longest = reel_window_scan(w, i, longest);
+                    PT_YIELD(t);
+                }
+                reel_set_window(w, longest);
+            }
+            disc_print_window(w);
+        }
+    }
 
-    print_string("\nDISC optic readout  (# = light, . = dark, 48/line)\n");
+    print_string("\nDISC readout done\n");
+    PT_SLEEP(t, 2000);
+    PT_END(t);
+}
 
-    // Label "dISC" on the displays
-    write_both(7, 0xd); write_both(6, 1); write_both(5, 5); write_both(4, 0xc);
-    write_both(3, 0); write_both(2, 0); write_both(1, 0); write_both(0, 0);
-    refresh_display();
+/**
+ * @brief Print position and signature state of every reel
+ */
+void reel_print_status() {
+    for (uint8_t w = 0; w < REEL_COUNT; w++) {
+        print_string("WHEEL ");
+        print_serial_char((char)('1' + w));
+        if (!reel_window[w]) {
+            print_string(" not learned\n");
+            continue;
+        }
+        print_string(" window ");
+        print_dec(reel_window[w]);
+        if (reel_homed & (1 << w)) {
+            print_string(" pos ");
+            print_dec(reel_pos[w]);
+        } else {
+            print_string(" not homed");
+        }
+        print_string(" missed ");
+        print_dec(reel_missed[w]);
+        print_string(" extra ");
+        print_dec(reel_extra[w]);
+        print_serial_char('\n');
+    }
+}
 
-    for (uint8_t w = 0; w < 3; w++) {
-        uint8_t shift = (uint8_t)(w * 2);
-        uint8_t optic_mask = (uint8_t)(1 << w);
+/**
+ * @brief Report a reel that has lost step, with the RTC time
+ *
+ * @param w Reel 0..2
+ */
+void reel_fault_report(uint8_t w) {
+    print_string("\nREEL ");
+    print_serial_char((char)('1' + w));
+    print_string(" STALL ");
+    print_hex8(rtc_get_hours()); print_serial_char(':');
+    print_hex8(rtc_get_minutes()); print_serial_char(':');
+    print_hex8(rtc_get_seconds());
+    print_string(" missed ");
+    print_dec(reel_missed[w]);
+    print_string(" extra ");
+    print_dec(reel_extra[w]);
+    print_serial_char('\n');
+}
 
-        print_string("\nWHEEL ");
-        print_serial_char((char)('1' + w));
-        print_string(" (P2 ");
-        print_serial_char((char)('0' + shift));
-        print_serial_char('/');
-        print_serial_char((char)('0' + shift + 1));
-        print_string(", optic P1.");
-        print_serial_char((char)('0' + w));
-        print_string(")\n");
-
-        write_both(0, (uint8_t)(w + 1));   // show current wheel on display
-        refresh_display();
+#define REEL_WATCH_PERIOD 50    // ms
 
-        for (uint16_t step = 0; step < STEPS; step++) {
-            set_port2((uint8_t)(gray[step & 3] << shift));   // drive only this wheel
-            delay(10);                                       // let the rotor step + settle
-            uint8_t optic = (read_port1() & optic_mask) ? 1 : 0;
-            print_serial_char(optic ? '#' : '.');
-            if ((step % 48) == 47)
-                print_serial_char('\n');
-            if (test_cancelled()) {
-                set_port2(0xff);
-                print_string("\ncancelled\n");
-                return;
+/**
+ * @brief Task: report reels that lost step and home them again
+ *
+ * A faulty reel finishes its move, is homed again and then sent on to the
+ * target it had. Waits while a test is running, the disc readout learns
+ * the reels anew anyway, and while "REEL HOME" is homing the reel.
+ */
+uint8_t reel_watch_task(struct task_t* t) {
+    static uint8_t w, target;
+
+    PT_BEGIN(t);
+    while (1) {
+        PT_SLEEP(t, REEL_WATCH_PERIOD);
+        for (w = 0; w < REEL_COUNT; w++) {
+            if (!(reel_fault & (1 << w)))
+                continue;
+            reel_fault_report(w);
+            target = reel_target[w];
+            PT_WAIT_UNTIL(t, !reel_busy(w) && !(reel_homing & (1 << w)) && !test_running());
+            if (!(reel_fault & (1 << w)))
+                continue;               // learned or homed meanwhile
+            reel_clear_fault(w);
+            if (!reel_home_start(w))
+                continue;
+            PT_WAIT_UNTIL(t, !reel_busy(w));
+            if (reel_home_finish(w)) {
+                print_string("re-homed\n");
+                reel_goto(w, target, 0);
+            } else {
+                print_string("re-home failed\n");
             }
         }
-        set_port2(0xff);             // idle the coils between wheels
-        print_serial_char('\n');
     }
+    PT_END(t);
+}
 
-    print_string("\nDISC readout done\n");
-    for (uint16_t i = 0; i < 2000 && !test_cancelled(); i++) dumb_delay(1);
+/**
+ * @brief Task: home every learned reel at once, then report
+ *
+ * Only the reels whose homing run actually started are finished, a reel that
+ * was still busy or being homed by reel_watch_task keeps its position and
+ * speed.
+ */
+uint8_t reel_home_task(struct task_t* t) {
+    static uint8_t w;
+    static uint8_t started;
+
+    PT_BEGIN(t);
+    started = 0;
+    for (w = 0; w < REEL_COUNT; w++) {
+        if (reel_home_start(w))
+            started |= 1 << w;
+    }
+    PT_WAIT_UNTIL(t, !reel_busy(0) && !reel_busy(1) && !reel_busy(2));
+    for (w = 0; w < REEL_COUNT; w++) {
+        if (started & (1 << w))
+            reel_home_finish(w);
+    }
+    reel_print_status();
+    PT_END(t);
 }
 
 /**
@@ -1243,49 +2697,271 @@ void menu_disc_readout() {
  *  1) REST state of all 8 sensor rows (TZ0..TZ7) exactly as the firmware reads
  *     them via IN 0x50 - this nails the idle polarity of every coin light
  *     barrier (LIM/LIG on TZ1, RUEM/LUE/ZEM/LIA on TZ2, etc).
- *  2) A fast burst capture of the two coin rows (TZ1, TZ2) into RAM while you
- *     drop a single coin through the validator, then a dump of every change
- *     (index:TZ1,TZ2). That shows the order/timing of the LIM denomination,
+ *  2) A fast burst capture of the two coin rows (TZ1, TZ2) while you drop a
+ *     single coin through the validator, sending every change (index:TZ1,TZ2)
+ *     as it happens. That shows the order/timing of the LIM denomination,
  *     RUEM, LIG and ZEM/Fadenfoul pulses so the emulated coin sequence can be
  *     made faithful.
  *
- * Capture window is COIN_NSAMP * ~3ms; drop the coin right after the prompt.
+ * In binary mode (capture_binary) the rest state goes out as one
+ * REMOTE_BLOCK_REST frame and the changes as REMOTE_BLOCK_COIN frames of
+ * (index delta, TZ1 xor previous, TZ2 xor previous) triples; capture.py turns
+ * them back into the text format.
+ *
+ * Capture window is COIN_NSAMP * 3 ms; drop the coin right after the prompt.
  * Return/INIT exits the trailing hold.
  */
 #define COIN_NSAMP 400
-void menu_coin_capture() {
-    static uint8_t b1[COIN_NSAMP];
-    static uint8_t b2[COIN_NSAMP];
 
+// The changes wait in a ring until the transmit queue has room for them, so
+// the capture keeps every change as long as the serial link keeps up on
+// average; a burst of bounce only has to fit into COIN_EVENTS.
+// COIN_EVENTS must be a power of two.
+struct coin_event_t {
+    uint16_t index;     // sample number
+    uint8_t tz1;
+    uint8_t tz2;
+};
+
+struct coin_event_t coin_events[COIN_EVENTS];
+uint8_t coin_head;      // next free slot
+uint8_t coin_tail;      // next change to send
+uint8_t coin_l1, coin_l2;           // last sample taken
+uint16_t coin_last;                 // last change sent, binary deltas count from it
+uint8_t coin_s1, coin_s2;
+bool coin_overflow;     // the link fell behind and changes were dropped
+
+// Binary blocks are kept small enough to go into an empty transmit queue
+// in one piece: 6 bytes of framing plus the triples
+#define COIN_BLOCK      ((TX_BUF_SIZE - 7) / 3 * 3)
+
+/**
+ * @brief Take one sample of the coin rows, queue it if it changed
+ *
+ * @param index Sample number
+ */
+void coin_sample(uint16_t index) {
+    uint8_t tz1 = sensor_snap[sensor_snap_cur][1];     // kept current by RST6.5
+    uint8_t tz2 = sensor_snap[sensor_snap_cur][2];
+    uint8_t next = (coin_head + 1) & (COIN_EVENTS - 1);
+    struct coin_event_t* e;
+
+    if (tz1 == coin_l1 && tz2 == coin_l2)
+        return;
+    coin_l1 = tz1;
+    coin_l2 = tz2;
+    if (next == coin_tail) {
+        coin_overflow = true;
+        return;
+    }
+    e = &coin_events[coin_head];
+    e->index = index;
+    e->tz1 = tz1;
+    e->tz2 = tz2;
+    coin_head = next;
+}
+
+/**
+ * @brief Send the queued coin changes
+ *
+ * Text mode sends a line per change. Binary mode sends REMOTE_BLOCK_COIN
+ * frames of triples: samples since the previous change, then TZ1 and TZ2
+ * XORed with their previous values. Gaps longer than 255 samples are
+ * bridged with (255, 0, 0) entries. The first change counts from index 0
+ * and is XORed with 0xEE.
+ *
+ * @param wait false to send only what fits into the transmit queue now,
+ *             true to send everything
+ */
+void coin_send(bool wait) {
+    static uint8_t block[COIN_BLOCK];
+    struct coin_event_t* e;
+
+    while (coin_tail != coin_head) {
+        if (!capture_binary) {
+            if (!wait && tx_free() < 11)
+                return;
+            e = &coin_events[coin_tail];
+            print_hex8((uint8_t)(e->index >> 8)); print_hex8((uint8_t)(e->index & 0xff));
+            print_serial_char(':');
+            print_hex8(e->tz1); print_serial_char(',');
+            print_hex8(e->tz2); print_serial_char('\n');
+            coin_tail = (coin_tail + 1) & (COIN_EVENTS - 1);
+            continue;
+        }
+
+        uint8_t n = 0;
+        uint8_t k = coin_tail;
+        uint16_t last = coin_last;
+        uint8_t l1 = coin_s1, l2 = coin_s2;
+        while (k != coin_head && n < sizeof(block)) {
+            e = &coin_events[k];
+            if (e->index - last > 255) {
+                block[n++] = 255; block[n++] = 0; block[n++] = 0;
+                last += 255;
+                continue;
+            }
+            block[n++] = (uint8_t)(e->index - last);
+            block[n++] = e->tz1 ^ l1;
+            block[n++] = e->tz2 ^ l2;
+            last = e->index; l1 = e->tz1; l2 = e->tz2;
+            k = (k + 1) & (COIN_EVENTS - 1);
+        }
+        if (!wait && tx_free() < n + 6)
+            return;
+        remote_block(REMOTE_BLOCK_COIN, 0, 0, block, n);
+        coin_tail = k;
+        coin_last = last; coin_s1 = l1; coin_s2 = l2;
+    }
+}
+
+/**
+ * @brief Print the rest state of all sensor rows, first part of the coin capture
+ */
+void coin_print_rest() {
+    uint8_t irq = irq_save();
+    memcpy(sensor_ram, sensor_snap[sensor_snap_cur], 8);
+    irq_restore(irq);
+    if (capture_binary) {
+        remote_block(REMOTE_BLOCK_REST, 0, 0, sensor_ram, 8);
+    } else {
+        print_string("REST TZ0..TZ7: ");
+        for (uint8_t r = 0; r < 8; r++) { print_hex8(sensor_ram[r]); print_serial_char(' '); }
+        print_serial_char('\n');
+    }
+}
+
+uint8_t menu_coin_capture(struct task_t* t) {
+    static uint16_t i, next;
+
+    PT_BEGIN(t);
     print_string("\n=== COIN CAPTURE ===\n");
 
     // 1) idle rest state of every row, labelled
-    read_sensor_matrix();
-    print_string("REST TZ0..TZ7: ");
-    for (uint8_t r = 0; r < 8; r++) { print_hex8(sensor_ram[r]); print_serial_char(' '); }
-    print_serial_char('\n');
+    coin_print_rest();
 
     // 2) burst capture of the coin rows (TZ1 + TZ2) while a coin drops
     print_string("drop ONE coin now...\n");
-    for (uint16_t i = 0; i < COIN_NSAMP; i++) {
-        b1[i] = read_sram(1);
-        b2[i] = read_sram(2);
-        dumb_delay(3);
-    }
-
     print_string("idx:TZ1,TZ2 (changes only)\n");
-    uint8_t l1 = 0xee, l2 = 0xee;   // impossible seed so the first sample always prints
-    for (uint16_t i = 0; i < COIN_NSAMP; i++) {
-        if (b1[i] != l1 || b2[i] != l2) {
-            print_hex8((uint8_t)(i >> 8)); print_hex8((uint8_t)(i & 0xff));
-            print_serial_char(':');
-            print_hex8(b1[i]); print_serial_char(',');
-            print_hex8(b2[i]); print_serial_char('\n');
-            l1 = b1[i]; l2 = b2[i];
-        }
+    coin_head = coin_tail = 0;
+    coin_overflow = false;
+    coin_l1 = coin_l2 = 0xee;       // impossible seed so the first sample always counts
+    coin_s1 = coin_s2 = 0xee;
+    coin_last = 0;
+    next = millis16();
+    for (i = 0; i < COIN_NSAMP; i++) {
+        coin_sample(i);
+        coin_send(false);
+        next += 3;                  // fixed 3 ms sample period
+        PT_SLEEP_UNTIL(t, next);
     }
+
+    coin_send(true);
+    if (coin_overflow)
+        print_string("serial too slow, changes dropped\n");
     print_string("=== done ===\n");
-    for (uint16_t i = 0; i < 2000 && !test_cancelled(); i++) dumb_delay(1);
+    PT_SLEEP(t, 2000);
+    PT_END(t);
+}
+
+/**
+ * @brief Task that runs the current menu test
+ *
+ * Runs the test's own protothread on this task and files the result once
+ * the test has finished.
+ */
+uint8_t test_runner(struct task_t* t) {
+    if (test_body(t) == TASK_WAITING)
+        return TASK_WAITING;
+    test_end();
+    return TASK_DONE;
+}
+
+/**
+ * @brief Check whether a menu test task is running
+ */
+bool test_running() {
+    return test_task != 0;
+}
+
+/**
+ * @brief Start a menu test as a task
+ *
+ * @param item Menu item number, for test_result[]
+ * @param label Menu number and tag shown on the money display, 8 characters
+ * @param body Protothread of the test
+ * @param stop Called when the test is cancelled, to idle the hardware, or 0
+ */
+void test_start(uint8_t item, const char* label, task_fn body, void (*stop)()) {
+    display_scroll_stop();
+    display_text(0, label);
+    display_text(8, result_words[RESULT_NONE]);
+    test_body = body;
+    test_stop = stop;
+    test_item = item;
+    test_task = task_start(test_runner);
+    test_result[item] = RESULT_RUNNING;
+}
+
+/**
+ * @brief File the result of the test that just ended
+ */
+void test_end() {
+    test_result[test_item] = test_verdict;
+    display_text(8, result_words[test_verdict]);
+    test_task = 0;
+    remote_test_done(test_item);
+}
+
+/**
+ * @brief Stop the running test wherever it is waiting
+ */
+void test_cancel() {
+    if (!test_task)
+        return;
+    task_kill(test_task);
+    if (test_stop)
+        test_stop();
+    print_string("\ncancelled\n");
+    test_verdict = RESULT_CANCELLED;
+    test_end();
+}
+
+/**
+ * @brief Run one entry of the service menu
+ *
+ * Shared by the buttons in normal mode, the serial command line and the
+ * remote protocol. Quick items finish before this returns; tests that take
+ * longer are started as a task and run alongside the display and buttons,
+ * one at a time. Tests report their outcome through test_verdict, which
+ * is kept in test_result[] for the host to read back.
+ *
+ * @param item Menu item number (see handle_normal_mode)
+ */
+void run_menu_item(uint8_t item) {
+    if (test_running()) {
+        print_string("busy\n");
+        return;
+    }
+    test_verdict = RESULT_DONE;
+    switch (item) {
+        //case 0: menu_reset(); break;
+        case 1: menu_all_lamps_on(); break;
+        case 2: menu_edit_date(); break;
+        case 3: music_play(&track); break;
+        case 4: menu_edit_time(); break;
+        case 5: menu_clear_lamps(); break;
+        case 6: test_start(item, "06 8255 ", menu_lamp_test, lamp_stop); return;
+        case 7: menu_all_lamps_on(); break;
+        case 8: test_start(item, "08 8256 ", menu_8256_test, 0); return;
+        case 9: test_start(item, "09 8279 ", menu_8279_test, 0); return;
+        case 10: test_start(item, LABEL_RAM, menu_ram_test, 0); return;
+        case 11: test_start(item, LABEL_RTC, menu_rtc_test, 0); return;
+        case 12: test_start(item, "12 d15C ", menu_disc_readout, disc_stop); return;
+        case 13: test_start(item, "13 C0   ", menu_coin_capture, 0); return;
+    }
+    if (item < MENU_ITEMS)
+        test_result[item] = test_verdict;
 }
 
 /**
@@ -1294,7 +2970,7 @@ void menu_coin_capture() {
 void handle_normal_mode(bool buttonl, bool buttons, bool buttonr, bool buttonret) {
     // Bounds check BEFORE any access
     if (menu_item < 0) menu_item = 0;
-    if (menu_item >= 14) menu_item = 13;
+    if (menu_item >= MENU_ITEMS) menu_item = MENU_ITEMS - 1;
     
     write_both(0, menu_item);
     write_both(1, buttonl);
@@ -1304,51 +2980,287 @@ void handle_normal_mode(bool buttonl, bool buttons, bool buttonr, bool buttonret
 
     if (buttonl) {
         menu_item--;
-        dumb_delay(200);
     } else if (buttonr) {
         menu_item++;
-        dumb_delay(200);
     }
 
     if (buttonret) {
         menu_item = 0;
-        dumb_delay(200);
     }
 
     if (buttons) {
-        switch (menu_item) {
-            //case 0: menu_reset(); break;
-            case 1: menu_all_lamps_on(); break;
-            case 2: menu_edit_date(); break;
-            case 3: menu_play_music(); break;
-            case 4: menu_edit_time(); break;
-            case 5: menu_clear_lamps(); break;
-            case 6: menu_lamp_test(); break;
-            case 7: menu_all_lamps_on(); break;
-            case 8: menu_8256_test(); break;
-            case 9: menu_8279_test(); break;
-            case 10: menu_ram_test(); break;
-            case 11: menu_rtc_test(); break;
-            case 12: menu_disc_readout(); break;
-            case 13: menu_coin_capture(); break;
-        }
-        dumb_delay(200);
+        run_menu_item(menu_item);
     }
 
     // Wrap menu item
-    if (menu_item < 0) menu_item = 13;
-    if (menu_item >= 14) menu_item = 0;
+    if (menu_item < 0) menu_item = MENU_ITEMS - 1;
+    if (menu_item >= MENU_ITEMS) menu_item = 0;
+}
+
+/**
+ * @brief Handle a command line received over serial
+ *
+ * A decimal number runs that menu item, as if it had been selected with
+ * the buttons. "STAT" reports the receiver error counters, "BAUD [rate]"
+ * shows or changes the baud rate and "AUTOBAUD" detects it from the host.
+ * "BIN 1" / "BIN 0" switch the capture tests to binary blocks and back.
+ * "PLAY", "STOP", "PAUSE", "RESUME", "TEMPO <percent>" and
+ * "TRANSPOSE <semitones>" control the background music.
+ * "LAMPS CHASE", "LAMPS BLINK" and "LAMPS OFF" loop a lamp sequence.
+ * "KEYMAP [CABINET|EMULATOR]" shows or changes the saved button layout.
+ * "SHOW <text>" puts text on the digits, scrolling if it does not fit.
+ * "REEL" reports the reels, "REEL HOME" homes the ones with a signature
+ * (learned by the disc readout) and "REEL <wheel 1-3> <pos>" turns a homed
+ * reel to a position. "DISC ALL" / "DISC ONE" make the disc readout step the wheels together or one after the other.
+ *
+ * @param line NUL-terminated command line from serial_getline()
+ */
+void handle_serial_line(const char* line) {
+    if (line[0] >= '0' && line[0] <= '9') {
+        uint16_t item = parse_dec(line);
+        if (item < MENU_ITEMS) {
+            run_menu_item(item);
+            return;
+        }
+    } else if (strcmp(line, "BIN 0") == 0 || strcmp(line, "BIN 1") == 0) {
+        capture_binary = line[4] == '1';
+        print_string("ok\n");
+        return;
+    } else if (strcmp(line, "AUTOBAUD") == 0) {
+        autobaud();
+        return;
+    } else if (strncmp(line, "BAUD", 4) == 0) {
+        if (line[4] == ' ') {
+            uint16_t rate = parse_dec(line + 5);
+            uint8_t i;
+            for (i = 0; i < BAUD_COUNT && baud_table[i].rate != rate; i++) { }
+            if (i == BAUD_COUNT) {
+                print_string("?\n");
+                return;
+            }
+            print_string("ok\n");
+            set_baud(i);
+            settings_save();
+            return;
+        }
+        print_string("baud "); print_dec(baud_table[baud_index].rate);
+        print_serial_char('\n');
+        return;
+    } else if (strcmp(line, "PLAY") == 0) {
+        music_play(&track);
+        return;
+    } else if (strcmp(line, "STOP") == 0) {
+        music_stop();
+        return;
+    } else if (strcmp(line, "PAUSE") == 0 || strcmp(line, "RESUME") == 0) {
+        music_pause(line[0] == 'P');
+        return;
+    } else if (strcmp(line, "LAMPS CHASE") == 0) {
+        lamp_play(lamp_seq_chase, true);
+        return;
+    } else if (strcmp(line, "LAMPS BLINK") == 0) {
+        lamp_play(lamp_seq_blink, true);
+        return;
+    } else if (strcmp(line, "LAMPS OFF") == 0) {
+        lamp_stop();
+        return;
+    } else if (strncmp(line, "TEMPO ", 6) == 0) {
+        music_set_tempo(parse_dec(line + 6));
+        return;
+    } else if (strncmp(line, "TRANSPOSE ", 10) == 0) {
+        if (line[10] == '-')
+            music_set_transpose(-(int8_t)parse_dec(line + 11));
+        else
+            music_set_transpose((int8_t)parse_dec(line + 10));
+        return;
+    } else if (strncmp(line, "SHOW ", 5) == 0) {
+        static char show_text[RX_LINE_SIZE + 1];
+        display_scroll_stop();
+        strcpy(show_text, line + 5);
+        display_scroll(show_text);
+        return;
+    } else if (strcmp(line, "DISC ALL") == 0 || strcmp(line, "DISC ONE") == 0) {
+        disc_parallel = line[5] == 'A';
+        print_string("ok\n");
+        return;
+    } else if (strcmp(line, "REEL") == 0) {
+        reel_print_status();
+        return;
+    } else if (strcmp(line, "REEL HOME") == 0) {
+        if (test_running() || !task_start(reel_home_task))
+            print_string("busy\n");
+        return;
+    } else if (strncmp(line, "REEL ", 5) == 0 && line[5] >= '1' && line[5] <= '3' && line[6] == ' ') {
+        uint8_t w = line[5] - '1';
+        uint16_t pos = parse_dec(line + 7);
+        if (test_running() || pos >= REEL_STEPS_REV || !(reel_homed & (1 << w))) {
+            print_string("?\n");
+            return;
+        }
+        reel_goto(w, (uint8_t)pos, 0);
+        print_string("ok\n");
+        return;
+    } else if (strncmp(line, "KEYMAP", 6) == 0) {
+        if (line[6] == ' ') {
+            uint8_t i;
+            for (i = 0; i < KEYMAP_COUNT && strcmp(line + 7, keymap_names[i]) != 0; i++) { }
+            if (i == KEYMAP_COUNT) {
+                print_string("?\n");
+                return;
+            }
+            keymap_set(i);
+            settings_save();
+        }
+        keymap_print();
+        return;
+    } else if (strcmp(line, "STAT") == 0) {
+        print_string("rx overrun "); print_hex8(rx_overrun >> 8); print_hex8(rx_overrun & 0xFF);
+        print_string(" framing "); print_hex8(rx_framing >> 8); print_hex8(rx_framing & 0xFF);
+        print_string(" parity "); print_hex8(rx_parity >> 8); print_hex8(rx_parity & 0xFF);
+        print_string(" dropped "); print_hex8(rx_dropped >> 8); print_hex8(rx_dropped & 0xFF);
+        print_serial_char('\n');
+        return;
+    }
+    print_string("?\n");
+}
+
+/**
+ * @brief Act on one pressed (or repeating) button
+ *
+ * @param actions BUTTON_ACTION bits of the button, 0 for none
+ */
+void handle_key(uint8_t actions) {
+    bool buttonl = (actions & ACT_LEFT) != 0;
+    bool buttons = (actions & ACT_SELECT) != 0;
+    bool buttonr = (actions & ACT_RIGHT) != 0;
+    bool buttonret = (actions & ACT_RETURN) != 0;
+
+    if (actions & ACT_HW_TEST) {
+        run_menu_item(3);
+    }
+    if (actions & ACT_DATE) {
+        menu_edit_date();
+    }
+    if (actions & ACT_TIME) {
+        menu_edit_time();
+    }
+
+    // Mode handling
+    if (date_edit_mode) {
+        handle_date_edit_mode(buttonl, buttons, buttonr, buttonret);
+    } else if (time_edit_mode) {
+        handle_time_edit_mode(buttonl, buttons, buttonr, buttonret);
+    } else {
+        handle_normal_mode(buttonl, buttons, buttonr, buttonret);
+    }
+}
+
+/**
+ * @brief Scan the buttons and act on the queued key events
+ *
+ * Presses and auto-repeats drive the menu, a long press of KEYMAP_KEY
+ * switches the keymap and release events are not used. While a test is
+ * running the buttons only cancel it.
+ */
+void handle_buttons() {
+    static bool keys_shown = false;     // digits 1-4 still show the last press
+    struct key_event_t ev;
+    bool handled = false;
+
+    scan_buttons();
+    key_timers();
+
+    while (key_get(&ev)) {
+        if (ev.type == KEY_LONG && ev.row == BUTTON_ROW(KEYMAP_KEY)
+                && ev.mask == BUTTON_MASK(KEYMAP_KEY) && !test_running()) {
+            keymap_next();
+            continue;
+        }
+        if (ev.type != KEY_PRESS && ev.type != KEY_REPEAT)
+            continue;
+        display_scroll_stop();
+        uint8_t actions = button_actions(ev.row, ev.mask);
+        if (test_running()) {
+            if (ev.type == KEY_PRESS && (actions & ACT_CANCEL))
+                test_cancel();
+            continue;
+        }
+        handle_key(actions);
+        handled = true;
+    }
+
+    // One idle pass after a press clears the button digits again, then the
+    // digits are left alone so test results and text stay readable
+    if (handled) {
+        keys_shown = true;
+    } else if (keys_shown && !test_running()) {
+        handle_key(0);
+        keys_shown = false;
+    }
+}
+
+/**
+ * @brief Task: refresh the display
+ */
+uint8_t display_task(struct task_t* t) {
+    PT_BEGIN(t);
+    clock_deadline = millis16();
+    while (1) {
+        if (deadline_passed(clock_deadline)) {
+            clock_deadline += CLOCK_PERIOD;
+            // the clock keeps running while it is edited
+            if (date_edit_mode)
+                display_rtc_date();
+            if (time_edit_mode)
+                display_rtc_time();
+        }
+        display_scroll_update();
+        refresh_display();
+        PT_SLEEP(t, DISPLAY_PERIOD);
+    }
+    PT_END(t);
+}
+
+/**
+ * @brief Task: scan and debounce the buttons, run the menu
+ *
+ * There is no lockout after a press: every press is its own event, and
+ * held navigation buttons step on through auto-repeat.
+ */
+uint8_t keys_task(struct task_t* t) {
+    PT_BEGIN(t);
+    while (1) {
+        handle_buttons();
+        PT_SLEEP(t, KEYS_PERIOD);
+    }
+    PT_END(t);
+}
+
+/**
+ * @brief Task: run commands and frames received on the serial console
+ */
+uint8_t serial_task(struct task_t* t) {
+    static char line[RX_LINE_SIZE + 1];
+
+    PT_BEGIN(t);
+    while (1) {
+        if (serial_getline(line, sizeof(line)))
+            handle_serial_line(line);
+        PT_YIELD(t);
+    }
+    PT_END(t);
 }
 
 /**
  * @brief Main program entry point
  *
- * Initializes the controllers, plays the track
- * and then displays the state of the inputs on the lamp matrix
- * and echoes back any serial input
+ * Initializes the controllers, then hands over to the task scheduler:
+ * display refresh, button scan and the serial console each run as a task,
+ * and the menu tests start as tasks of their own
  */
 int main(void) {
     init_kdc();
+    settings_load();
     init_muart();
     init_ppi();
 
@@ -1361,63 +3273,27 @@ int main(void) {
 
     print_string("Test ROM Initialized\n");
 
-    calibrate_buttons();    // Sample button rest state for auto polarity detection
-
-    _8085_int7();           // Initialize timer5 for blinking
+    init_tick();            // 1 ms system tick, needed by delay()
+    reels_release();        // reel engine in step with the idle Port 2
+    init_blink();           // timer 5 blinks the selected digit
     enable_interrupts();     // Enable interrupts - but handlers are now minimal!
 
+    keymap_set(keymap_index);   // saved button layout, a long SPIELZ press switches it
+    calibrate_buttons();    // Sample button rest state, then let RST6.5 track changes
+    key_set_repeat(RUNTER01, true);     // menu and digit navigation
+    key_set_repeat(HOCH1, true);
+    key_set_repeat(RISK_LEFT, true);
+    key_set_repeat(RISK_RIGHT, true);
+
     write_lamps(0, 0x16);   // light up pressable buttons
     write_lamps(3, 0xc0);   // return
 
-    // Infinite loop to scan the keyboard
-    while (1) {
-        // Sample + debounce buttons - no interrupt protection needed since ISR is minimal
-        scan_buttons();
-
-        // Edge-triggered: one step per physical press (fixes navigation double-stepping)
-        #ifdef EMULATOR // current mame on master has the risk buttons reversed
-        bool buttonl = check_button_edge(RUNTER01);
-        bool buttons = check_button_edge(GEWINN);
-        bool buttonr = check_button_edge(HOCH1);
-        bool buttonret = check_button_edge(INIT);
-        #else
-        bool buttonl = check_button_edge(RUNTER01) | check_button_edge(RISK_LEFT);
-        bool buttons = check_button_edge(GEWINN) | check_button_edge(STOP_MID);
-        bool buttonr = check_button_edge(HOCH1) | check_button_edge(RISK_RIGHT);
-        bool buttonret = check_button_edge(INIT) | check_button_edge(RETURN);
-        #endif
-
-        if (check_button_edge(HW_TEST)) {
-            menu_play_music();
-        }
-        if (check_button_edge(DAUERLAUF)) {
-            menu_edit_date();
-        }
-        if (check_button_edge(FOUL)) {
-            menu_edit_time();
-        }
+    task_start(display_task);
+    task_start(keys_task);
+    task_start(serial_task);
+    task_start(reel_watch_task);
 
-        // Mode handling
-        if (date_edit_mode) {
-            handle_date_edit_mode(buttonl, buttons, buttonr, buttonret);
-        } else if (time_edit_mode) {
-            handle_time_edit_mode(buttonl, buttons, buttonr, buttonret);
-        } else {
-            handle_normal_mode(buttonl, buttons, buttonr, buttonret);
-        }
-
-        if (read_status() & I8256_STATUS_RBF) {
-            uint8_t rcv = read_serial_char();
-            print_serial_char(rcv);
-        }
-
-        // Software blink: timer5 ISR is not enabled, so drive blink_flag here
-        if (++blink_counter >= BLINK_PERIOD) {
-            blink_counter = 0;
-            blink_flag = !blink_flag;
-        }
-
-        // Always refresh display every loop - blink_flag is used for effects
-        refresh_display();
+    while (1) {
+        task_run_all();
     }
 }
@@ -0,0 +1,209 @@
+/**
+ * @file music.c
+ * @brief Background music player driven by the system tick
+ *
+ * The sound board plays one note at a time: the note byte is written to the
+ * SOUND port and a pulse on COUNTERS_START_SOUND starts it, the board then
+ * times the note's duration by itself. This player runs entirely from
+ * interrupts, so music keeps playing under any menu:
+ *
+ *  - music_tick() is called from every timer 2 tick (1.024 kHz). It
+ *    ends the start pulse after MUSIC_STROBE_TICKS, counts down the time to
+ *    the next note (scaled by the tempo) and starts the next note.
+ *  - The sound board raises RST5.5 when a note has finished. RST5.5 is level
+ *    triggered, so music_note_end() masks it again and it is only unmasked
+ *    while a note is sounding. Boards that never raise it lose nothing but
+ *    the music_sounding status.
+ *  - Lyrics go into the serial transmit queue without blocking; whatever
+ *    does not fit is sent on the following ticks.
+ *
+ * Songs are stored in the packed track format of music.h and decoded one
+ * note at a time while playing.
+ *
+ * @author stonedDiscord
+ * @date 17.10.2026
+ */
+#ifndef HEADER_MUSIC_PLAYER
+#define HEADER_MUSIC_PLAYER
+
+#include "music.h"
+
+#define MUSIC_TEMPO_NORMAL  100     // percent
+#define MUSIC_TEMPO_MIN     25
+#define MUSIC_TEMPO_MAX     400
+#define MUSIC_STROBE_TICKS  2       // start pulse length, at least one full ms
+
+const struct song_t* music_song;
+const uint8_t* music_next;              // next entry of the note stream
+uint8_t music_length;                   // length of the last note, for deltas
+volatile uint16_t music_left;           // ticks to the next note, at normal tempo
+volatile uint16_t music_tempo_acc;
+volatile uint16_t music_tempo = MUSIC_TEMPO_NORMAL;
+volatile int8_t music_transpose = 0;    // semitones, positive is higher
+volatile bool music_playing = false;
+volatile bool music_paused = false;
+volatile uint8_t music_strobe = 0;      // ticks until the start pulse ends
+volatile bool music_sounding = false;   // started, RST5.5 not seen yet
+const char* music_lyric = 0;            // rest of a lyric still to send
+
+/**
+ * @brief Apply the transpose to a SOUND port byte
+ *
+ * Notes count down in pitch from C, octaves from A8, so one rank step is a
+ * semitone lower. The result is clamped to the four octaves the board can
+ * play.
+ *
+ * @param port Port byte from the track
+ * @return uint8_t Value for the SOUND port
+ */
+uint8_t music_port_byte(uint8_t port) {
+    int16_t rank;
+    uint8_t octave = 0;
+
+    if (music_transpose == 0)
+        return port;
+
+    rank = (port >> 6) * 12 + ((port & 0x0F) - NOTE_C) - music_transpose;
+    if (rank < 0)
+        rank = 0;
+    if (rank > 4 * 12 - 1)
+        rank = 4 * 12 - 1;
+    while (rank >= 12) {
+        rank -= 12;
+        octave++;
+    }
+    return (uint8_t)((rank + NOTE_C) | (port & 0x30) | (octave << 6));
+}
+
+/**
+ * @brief Decode and start the next note, and schedule the one after it
+ *
+ * Stops the player at the end of the track.
+ */
+void music_start_note() {
+    uint8_t port = *music_next++;
+    uint8_t ctrl;
+
+    if (port == TRACK_END) {
+        music_playing = false;
+        return;
+    }
+
+    ctrl = *music_next++;
+    if (ctrl & TRACK_LYRIC)
+        music_lyric = music_song->lyrics + music_song->lyric_offset[*music_next++];
+    if (ctrl & TRACK_ABS)
+        music_length = *music_next++;
+    else if (ctrl & 0x20)
+        music_length -= (uint8_t)(0x40 - (ctrl & 0x3F));     // negative delta
+    else
+        music_length += ctrl & 0x3F;
+
+    if (port & 0x0F) {
+        set_sound(music_port_byte(port));
+        counter_out(COUNTERS_START_SOUND);
+        music_strobe = MUSIC_STROBE_TICKS;
+        music_sounding = true;
+    }
+    music_left = music_length * TRACK_TICKS_PER_LENGTH;
+}
+
+/**
+ * @brief Advance the player by one timer tick
+ *
+ * Called from the timer 2 tick with interrupts disabled.
+ */
+void music_tick() {
+    if (music_strobe && --music_strobe == 0) {
+        counter_out(0);
+        unmask_rst(SIM_MASK_55);        // listen for the end of the note
+    }
+
+    while (music_lyric && *music_lyric) {
+        if (!tx_try_put(*music_lyric))
+            break;                      // queue full, go on next tick
+        music_lyric++;
+    }
+
+    if (!music_playing || music_paused)
+        return;
+
+    music_tempo_acc += music_tempo;
+    while (music_tempo_acc >= MUSIC_TEMPO_NORMAL) {
+        music_tempo_acc -= MUSIC_TEMPO_NORMAL;
+        if (music_left)
+            music_left--;
+    }
+    if (music_left)
+        return;
+
+    music_start_note();
+}
+
+/**
+ * @brief The sound board has finished a note (RST5.5)
+ */
+void music_note_end() {
+    mask_rst(SIM_MASK_55);
+    music_sounding = false;
+}
+
+/**
+ * @brief Start playing a song from the beginning
+ *
+ * @param song Packed song
+ */
+void music_play(const struct song_t* song) {
+    uint8_t irq = irq_save();
+    music_song = song;
+    music_next = song->notes;
+    music_length = 0;
+    music_tempo_acc = 0;
+    music_paused = false;
+    music_playing = true;
+    music_start_note();
+    irq_restore(irq);
+}
+
+/**
+ * @brief Stop the song, the current note still plays out
+ */
+void music_stop() {
+    uint8_t irq = irq_save();
+    music_playing = false;
+    music_paused = false;
+    irq_restore(irq);
+}
+
+/**
+ * @brief Hold or continue the song at the current note
+ *
+ * @param pause true to hold, false to continue
+ */
+void music_pause(bool pause) {
+    music_paused = pause;
+}
+
+/**
+ * @brief Set the playback speed
+ *
+ * @param percent Speed in percent of the written tempo, 25..400
+ */
+void music_set_tempo(uint16_t percent) {
+    if (percent < MUSIC_TEMPO_MIN)
+        percent = MUSIC_TEMPO_MIN;
+    if (percent > MUSIC_TEMPO_MAX)
+        percent = MUSIC_TEMPO_MAX;
+    music_tempo = percent;
+}
+
+/**
+ * @brief Shift every following note in pitch
+ *
+ * @param semitones Semitones up (positive) or down (negative)
+ */
+void music_set_transpose(int8_t semitones) {
+    music_transpose = semitones;
+}
+
+#endif
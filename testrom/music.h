@@ -33,13 +33,39 @@ typedef enum duration {
     DURATION_WHOLE = 3,
 } duration_t;
 
-struct noteData
-{
-    note_t note: 4;
-    octave_t octave: 2;
-    duration_t duration: 2;
-    uint8_t length; //divided by 8
-    const char* lyric; //lyric text for this note
+/*
+ * Packed track format
+ *
+ * A track is a byte stream, one entry per note:
+ *
+ *   PORT | CTRL | [LYRIC] | [LENGTH]
+ *
+ * PORT    the SOUND port byte, see TRACK_NOTE(). TRACK_END (0x00) ends the
+ *         track, any other byte with note NOTE_INVALID is a rest.
+ * CTRL    bit 7 TRACK_LYRIC: a lyric index byte follows.
+ *         bit 6 TRACK_ABS: an absolute length byte follows, otherwise
+ *         bits 0-5 are a signed delta (-32..31) to the previous length.
+ * LENGTH  time until the next note starts, in units of
+ *         TRACK_TICKS_PER_LENGTH timer 2 ticks (1.024 kHz on every board).
+ *
+ * Lyrics are NUL-terminated strings in one pool, found through an offset
+ * table so that repeated syllables are stored once.
+ */
+#define TRACK_TICKS_PER_LENGTH  4   // 3.9 ms, up to 1 s per byte
+
+#define TRACK_END       0x00
+#define TRACK_LYRIC     0x80
+#define TRACK_ABS       0x40
+#define TRACK_DELTA(d)  ((uint8_t)((d) & 0x3F))
+
+#define TRACK_NOTE(note, octave, duration) \
+    (uint8_t)((note) | ((duration) << 4) | ((octave) << 6))
+#define TRACK_REST      TRACK_NOTE(NOTE_INVALID, A5, DURATION_EIGHTH)
+
+struct song_t {
+    const uint8_t* notes;           // packed note stream
+    const char* lyrics;             // lyric pool
+    const uint16_t* lyric_offset;   // start of each lyric in the pool
 };
 
 #endif
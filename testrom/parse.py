@@ -6,18 +6,29 @@ This script converts MIDI files to C arrays for the 8085 music player.
 It extracts note events, timing, and generates the track.c file.
 
 Usage:
-    python3 parse.py <input.mid> <output.c>
-    
+    python3 parse.py [options] <input.mid> <output.c>
+
+Options:
+    --policy=highest    keep the highest of overlapping notes (default)
+    --policy=lowest     keep the lowest of overlapping notes
+    --policy=melody     keep only the notes of one track, see --track
+    --track=<n>         MIDI track number holding the melody
+    --verbose           print the start time error of every note
+
 Example:
-    python3 parse.py apple.mid track.c
+    python3 parse.py --policy=melody --track=1 apple.mid track.c
 
-The output file contains an array with entries for:
-- note: Note name (NOTE_C, NOTE_D, NOTE_E, etc.)
-- octave: Octave (A8, A7, A6, A5)
-- duration: Note duration (DURATION_EIGHTH, DURATION_QUARTER, etc.)
-- delay: Delay in milliseconds between note starts
+The output file contains the song in the packed track format described in
+music.h: a byte stream with the pre-packed sound port byte of every note,
+delta-coded lengths (time between note starts) and indexes into a pool of
+lyric strings.
 
-This array is used by the 8085 music player to play back the MIDI file.
+Timing follows every tempo change of the file and is given in units of the
+music player's timer ticks, so it does not depend on the CPU clock of the
+board. The sound board plays one note at a time, so chords and overlapping
+notes are reduced to a single voice first. Lyric and text events of the MIDI file are attached to the
+note starting at the same time. The struct song_t named "track" is what the
+music player in music.c plays.
 """
 
 import mido
@@ -106,11 +117,8 @@ def octave_to_enum(octave):
     else:
         return 3  # A5
 
-def ticks_to_duration(ticks, ticks_per_beat, tempo):
-    """Convert MIDI ticks to duration enum"""
-    # Calculate beats from ticks
-    beats = ticks / ticks_per_beat
-    
+def beats_to_duration(beats):
+    """Convert a note length in beats to duration enum"""
     # Map to duration enum based on the example timing
     # DURATION_EIGHTH = 0, DURATION_QUARTER = 1, DURATION_HALF = 2, DURATION_WHOLE = 3
     if beats <= 0.5:
@@ -122,132 +130,328 @@ def ticks_to_duration(ticks, ticks_per_beat, tempo):
     else:
         return 3  # DURATION_WHOLE
 
+# Timer 2 of the 8256 counts at 1.024 kHz on every board, the music player
+# counts lengths in units of TRACK_TICKS_PER_LENGTH of its ticks (music.h)
+TIMER_HZ = 1024
+TRACK_TICKS_PER_LENGTH = 4
+
+POLICIES = ('highest', 'lowest', 'melody')
+
+def build_tempo_map(mid):
+    """
+    Collect every set_tempo event of the file
+
+    Returns a sorted list of (tick, seconds at that tick, tempo) segments, so
+    any MIDI tick can be converted to seconds with tick_to_seconds().
+    """
+    changes = {}
+    for track in mid.tracks:
+        tick = 0
+        for msg in track:
+            tick += msg.time
+            if msg.type == 'set_tempo':
+                changes[tick] = msg.tempo
+    if 0 not in changes:
+        changes[0] = 500000     # MIDI default, 120 bpm
+
+    segments = []
+    seconds = 0.0
+    last_tick, last_tempo = 0, None
+    for tick in sorted(changes):
+        if last_tempo is not None:
+            seconds += (tick - last_tick) * last_tempo / 1e6 / mid.ticks_per_beat
+        segments.append((tick, seconds, changes[tick]))
+        last_tick, last_tempo = tick, changes[tick]
+    return segments
+
+def tick_to_seconds(segments, tick, ticks_per_beat):
+    """Convert an absolute MIDI tick to seconds using the tempo map"""
+    start_tick, start_s, tempo = segments[0]
+    for segment in segments:
+        if segment[0] > tick:
+            break
+        start_tick, start_s, tempo = segment
+    return start_s + (tick - start_tick) * tempo / 1e6 / ticks_per_beat
+
 def parse_midi_file(filename):
-    """Parse MIDI file and extract note events"""
+    """
+    Parse MIDI file and extract every note and lyric
+
+    Returns (notes, lyrics). Each note is a dict with start/end in seconds,
+    the MIDI pitch, the track number and the length in beats. Lyrics are
+    (seconds, text) tuples.
+    """
     try:
         mid = mido.MidiFile(filename)
     except Exception as e:
         print(f"Error opening MIDI file: {e}")
-        return []
-    
-    # Get tempo (default to 500000 microseconds per beat if not specified)
-    tempo = 500000
-    for track in mid.tracks:
-        for msg in track:
-            if msg.type == 'set_tempo':
-                tempo = msg.tempo
-                break
-    
-    # Calculate ticks per quarter note
-    ticks_per_beat = mid.ticks_per_beat
-    
-    # Process all tracks to extract note events
-    note_events = []
-    
-    for track in mid.tracks:
+        return [], []
+
+    segments = build_tempo_map(mid)
+    tpb = mid.ticks_per_beat
+    notes = []
+    lyrics = []
+
+    for track_no, track in enumerate(mid.tracks):
         track_time = 0
-        active_notes = {}  # note -> start_time
-        
+        active_notes = {}  # (channel, note) -> start tick
+
         for msg in track:
             track_time += msg.time
-            
-            if msg.type == 'note_on' and msg.velocity > 0:
-                # Note start
-                if msg.note not in active_notes:
-                    active_notes[msg.note] = track_time
-                    
+
+            if msg.type in ('lyrics', 'text'):
+                lyrics.append((tick_to_seconds(segments, track_time, tpb), msg.text))
+
+            elif msg.type == 'note_on' and msg.velocity > 0:
+                active_notes.setdefault((msg.channel, msg.note), track_time)
+
             elif msg.type == 'note_off' or (msg.type == 'note_on' and msg.velocity == 0):
-                # Note end
-                if msg.note in active_notes:
-                    start_time = active_notes[msg.note]
-                    duration_ticks = track_time - start_time
-                    
-                    # Convert to our format
-                    note_enum, midi_octave = midi_note_to_enum_v2(msg.note)
-                    octave_enum = octave_to_enum(midi_octave)
-                    duration_enum = ticks_to_duration(duration_ticks, ticks_per_beat, tempo)
-                    
-                    # Calculate delay in milliseconds (will convert to relative delays later)
-                    ms_per_beat = tempo / 1000.0
-                    absolute_delay_ms = int((start_time / ticks_per_beat) * ms_per_beat)
-                    
-                    # Skip NOTE_INVALID entries (they would be silent)
-                    if note_enum == 0:  # NOTE_INVALID
-                        del active_notes[msg.note]
-                        continue
-                    
-                    note_events.append({
-                        'note': note_enum,
-                        'octave': octave_enum,
-                        'duration': duration_enum,
-                        'absolute_delay': absolute_delay_ms
-                    })
-                    
-                    del active_notes[msg.note]
-    
-    # Convert absolute delays to relative delays between consecutive events
-    for i in range(1, len(note_events)):
-        delay = note_events[i]['absolute_delay'] - note_events[i-1]['absolute_delay']
-        # Ensure no negative delays - use absolute value for overlapping notes
-        note_events[i]['delay'] = abs(delay) // 8
-    
-    # First note has delay of 0 (starts immediately)
-    if note_events:
-        note_events[0]['delay'] = 0
-    
-    # Remove the temporary absolute_delay field
+                start = active_notes.pop((msg.channel, msg.note), None)
+                if start is None:
+                    continue
+                notes.append({
+                    'start': tick_to_seconds(segments, start, tpb),
+                    'end': tick_to_seconds(segments, track_time, tpb),
+                    'pitch': msg.note,
+                    'track': track_no,
+                    'beats': (track_time - start) / tpb,
+                })
+
+    notes.sort(key=lambda n: (n['start'], -n['pitch']))
+    return notes, lyrics
+
+def reduce_polyphony(notes, policy, melody_track=None):
+    """
+    Reduce the notes to the single voice of the sound board
+
+    highest: a note is dropped while a higher one is still sounding, and of
+             notes starting together the highest wins (skyline).
+    lowest:  the same, preferring the lowest note.
+    melody:  only notes of melody_track, the highest of a chord wins.
+
+    A kept note cuts off whatever was sounding before it.
+    """
+    if policy == 'melody':
+        notes = [n for n in notes if n['track'] == melody_track]
+        policy = 'highest'
+    better = (lambda a, b: a > b) if policy == 'highest' else (lambda a, b: a < b)
+
+    kept = []
+    for note in notes:
+        if kept:
+            last = kept[-1]
+            if abs(note['start'] - last['start']) < 1e-6:
+                if better(note['pitch'], last['pitch']):
+                    kept[-1] = note
+                continue
+            if note['start'] < last['end'] and not better(note['pitch'], last['pitch']):
+                continue
+        kept.append(note)
+    return kept
+
+def quantise(notes, lyrics):
+    """
+    Turn the single-voice notes into track events timed in timer ticks
+
+    Lengths are rounded on the running total, so rounding errors never add
+    up: every note starts within half a length unit of its exact time.
+    Returns the events and a list of (index, exact ms, played ms) per note.
+    """
+    unit_s = TRACK_TICKS_PER_LENGTH / TIMER_HZ
+    events = []
+    report = []
+    lyrics = sorted(lyrics)
+    lyric_i = 0
+    origin = notes[0]['start'] if notes else 0.0
+    played_units = 0
+
+    for i, note in enumerate(notes):
+        note_enum, midi_octave = midi_note_to_enum_v2(note['pitch'])
+        if i + 1 < len(notes):
+            next_start = notes[i + 1]['start']
+        else:
+            next_start = note['end']
+        next_units = round((next_start - origin) / unit_s)
+
+        text = ''
+        while lyric_i < len(lyrics) and lyrics[lyric_i][0] <= note['start'] + 1e-6:
+            text += lyrics[lyric_i][1]
+            lyric_i += 1
+
+        event = {
+            'note': note_enum,
+            'octave': octave_to_enum(midi_octave),
+            'duration': beats_to_duration(note['beats']),
+            'length': max(next_units - played_units, 0),
+        }
+        if text:
+            event['lyric'] = text
+        events.append(event)
+
+        report.append((i, (note['start'] - origin) * 1000, played_units * unit_s * 1000))
+        played_units += event['length']
+
+    return events, report
+
+def print_timing_report(report, verbose):
+    """Print the start time error of every note and a summary"""
+    if not report:
+        return
+    worst = max(abs(played - exact) for _, exact, played in report)
+    if verbose:
+        print(" note   exact ms  played ms  error ms")
+        for i, exact, played in report:
+            print(f"{i:5}  {exact:9.1f}  {played:9.1f}  {played - exact:+8.2f}")
+    print(f"Timing: {len(report)} notes, worst start error {worst:.2f} ms "
+          f"(unit {TRACK_TICKS_PER_LENGTH * 1000 / TIMER_HZ:.2f} ms)")
+
+note_names = ['INVALID', 'C', 'B', 'AS', 'A', 'GS', 'G', 'FS', 'F', 'E', 'DS', 'D', 'CS']
+
+TRACK_LENGTH_MAX = 255
+
+def c_string(text):
+    """Quote text as a C string literal"""
+    out = ''
+    for ch in text:
+        if ch == '\n':
+            out += '\\n'
+        elif ch in '"\\':
+            out += '\\' + ch
+        elif ' ' <= ch <= '~':
+            out += ch
+        else:
+            out += f'\\{ord(ch) & 0xFF:03o}'
+    return f'"{out}"'
+
+def split_long_notes(note_events):
+    """Split lengths over one byte into the note and following rests"""
+    out = []
     for event in note_events:
-        if 'absolute_delay' in event:
-            del event['absolute_delay']
-    
-    return note_events
+        length = event['length']
+        first = dict(event, length=min(length, TRACK_LENGTH_MAX))
+        out.append(first)
+        length -= first['length']
+        while length > 0:
+            part = min(length, TRACK_LENGTH_MAX)
+            out.append({'note': 0, 'octave': 3, 'duration': 0, 'length': part})
+            length -= part
+    return out
+
+def pack_track(note_events):
+    """
+    Encode note events in the packed track format of music.h
+
+    Returns a list of (C expressions, comment) per note and the lyric pool.
+    Identical lyrics share one pool entry.
+    """
+    entries = []
+    lyrics = []
+    last_length = None
+
+    for event in split_long_notes(note_events):
+        if event['note'] == 0:
+            port = 'TRACK_REST'
+        else:
+            port = f"TRACK_NOTE(NOTE_{note_names[event['note']]}, " \
+                   f"{['A8', 'A7', 'A6', 'A5'][event['octave']]}, " \
+                   f"DURATION_{['EIGHTH', 'QUARTER', 'HALF', 'WHOLE'][event['duration']]})"
+
+        ctrl = []
+        extra = []
+        lyric = event.get('lyric')
+        if lyric:
+            if lyric not in lyrics:
+                lyrics.append(lyric)
+            ctrl.append('TRACK_LYRIC')
+            extra.append(str(lyrics.index(lyric)))
+
+        length = event['length']
+        delta = None if last_length is None else length - last_length
+        if delta is not None and -32 <= delta <= 31:
+            ctrl.append(f'TRACK_DELTA({delta})')
+        else:
+            ctrl.append('TRACK_ABS')
+            extra.append(str(length))
+        last_length = length
+
+        entries.append(([port, ' | '.join(ctrl)] + extra, lyric))
+
+    if len(lyrics) > 256:
+        raise ValueError("more than 256 different lyrics")
+    return entries, lyrics
 
 def generate_track_c(note_events):
-    """Generate C code for track array"""
-    if not note_events:
-        return "struct noteData track[] = {};\n"
-    
-    lines = ["struct noteData track[] = {"]
-    
-    for i, event in enumerate(note_events):
-        # Map note enum values to string names
-        note_names = ['INVALID', 'C', 'B', 'AS', 'A', 'GS', 'G', 'FS', 'F', 'E', 'DS', 'D', 'CS']
-        line = f"    {{ .note = NOTE_{note_names[event['note']]}, " \
-               f".octave = {['A8', 'A7', 'A6', 'A5'][event['octave']]}, " \
-               f".duration = DURATION_{['EIGHTH', 'QUARTER', 'HALF', 'WHOLE'][event['duration']]}, " \
-               f".length = {event['delay']} }}"
-        
-        if i < len(note_events) - 1:
-            line += ","
+    """Generate C code for a packed track"""
+    entries, lyrics = pack_track(note_events)
+
+    lines = ['// Packed track generated by parse.py, format described in music.h',
+             '#include "music.h"', '', "const uint8_t track_notes[] = {"]
+    for exprs, lyric in entries:
+        line = "    " + ", ".join(exprs) + ","
+        if lyric:
+            line += " // " + c_string(lyric)
         lines.append(line)
-    
+    lines.append("    TRACK_END")
     lines.append("};")
-    return "\n".join(lines) + "\n"
+    lines.append("")
+
+    lines.append("const char track_lyrics[] =")
+    offsets = []
+    offset = 0
+    for lyric in lyrics:
+        offsets.append(offset)
+        offset += len(lyric.encode('latin-1')) + 1
+        lines.append(f"    {c_string(lyric)} \"\\0\"")
+    if not lyrics:
+        lines.append('    ""')
+    lines[-1] += ";"
+    lines.append("")
+
+    lines.append("const uint16_t track_lyric_offset[] = {")
+    for i in range(0, len(offsets), 8):
+        lines.append("    " + ", ".join(str(o) for o in offsets[i:i + 8]) + ",")
+    if not offsets:
+        lines.append("    0")
+    lines.append("};")
+    lines.append("")
+
+    lines.append("const struct song_t track = { track_notes, track_lyrics, track_lyric_offset };")
+
+    size = sum(len(exprs) for exprs, _ in entries) + 1 + offset + 2 * len(offsets)
+    return "\n".join(lines) + "\n", size
 
 def main():
-    if len(sys.argv) != 3:
-        print("Usage: python3 parse.py <input.mid> <output.c>")
+    args = [a for a in sys.argv[1:] if not a.startswith('--')]
+    options = dict(a[2:].partition('=')[::2] for a in sys.argv[1:] if a.startswith('--'))
+    policy = options.get('policy', 'highest')
+
+    if len(args) != 2 or policy not in POLICIES or (policy == 'melody' and 'track' not in options):
+        print(__doc__)
         sys.exit(1)
-    
-    input_file = sys.argv[1]
-    output_file = sys.argv[2]
-    
+
+    input_file = args[0]
+    output_file = args[1]
+
     print(f"Parsing MIDI file: {input_file}")
-    note_events = parse_midi_file(input_file)
-    
-    if not note_events:
+    notes, lyrics = parse_midi_file(input_file)
+    notes = reduce_polyphony(notes, policy, int(options.get('track', 0)))
+
+    if not notes:
         print("No note events found in MIDI file")
         sys.exit(1)
-    
-    print(f"Found {len(note_events)} note events")
-    
+
+    note_events, report = quantise(notes, lyrics)
+    print(f"Found {len(note_events)} notes after reducing to one voice ({policy})")
+    print_timing_report(report, 'verbose' in options)
+
     # Generate C code
-    c_code = generate_track_c(note_events)
-    
+    c_code, size = generate_track_c(note_events)
+    print(f"Packed track uses {size} bytes of ROM")
+
     # Write to output file
     with open(output_file, 'w') as f:
         f.write(c_code)
-    
+
     print(f"Generated track array written to: {output_file}")
 
 if __name__ == "__main__":
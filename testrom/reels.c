@@ -0,0 +1,468 @@
+/**
+ * @file reels.c
+ * @brief Stepper engine for the three reels, driven by the system tick
+ *
+ * Each reel is a 2-phase stepper on a bit pair of 8256 Port 2 (wheel w on
+ * bits 2w and 2w+1), one bit per coil giving the direction of its current.
+ * Full steps follow the firmware's gray sequence 0,1,3,2. The optic of
+ * wheel w is Port 1 bit w, active high.
+ *
+ * There are no half steps: they need one coil switched off between two
+ * full steps, and Port 2 has only the direction bit, no off state. Toggling
+ * that bit every tick might average the current out, but that has not
+ * been measured on these motors, so it is left out.
+ * REEL_POLARITY flips the coils a board has wired the other way.
+ *
+ * reel_tick() runs from every timer 2 tick and steps all three reels at
+ * once, each with its own target, top speed and ramp. A move starts at the
+ * slow end of reel_ramp_ticks[], speeds up one entry per step up to the
+ * reel's top speed and slows down the same way before the target, so the
+ * rotor never has to follow a step it cannot make. The main code only
+ * starts moves and checks reel_busy().
+ *
+ * Positions count steps forward, REEL_STEPS_REV per revolution; reels
+ * only turn forward.
+ *
+ * The coded disc gives the absolute position. reel_learn() keeps one
+ * revolution of optic samples as the wheel's signature, one bit per step,
+ * and reel_window_scan() works out the shortest window of consecutive
+ * samples that occurs only once around the disc, one start position per
+ * call so the caller can yield in between. Homing then only needs that
+ * many steps:
+ * reel_home_start() records them and reel_home_finish() looks them up in
+ * the signature. reel_homing marks a reel between the two, so only the task
+ * that started a homing run finishes it. A homed reel reaches any position with reel_goto() on the
+ * short way round instead of searching for a full revolution.
+ *
+ * While a homed reel moves, every sample is checked against its signature
+ * (reel_check), so a reel that misses or gains steps is noticed on the next
+ * optic edges and flagged in reel_fault.
+ *
+ * @author stonedDiscord
+ * @date 17.10.2026
+ */
+#ifndef HEADER_REELS
+#define HEADER_REELS
+
+#define REEL_COUNT          3
+#define REEL_STEPS_REV      48      // steps per revolution as the firmware counts them
+#define REEL_RAMP_LEN       10
+#define REEL_SIG_BYTES      (REEL_STEPS_REV / 8)
+
+// Port 2 bits of coils wired the other way round, the same on all boards so far
+#define REEL_POLARITY       0x00
+
+// Ticks per step along the ramp, from a standing start to full speed
+const uint8_t reel_ramp_ticks[REEL_RAMP_LEN] = { 10, 8, 6, 5, 4, 4, 3, 3, 2, 2 };
+
+// Full-step gray code to its index, the sequence is its own inverse
+const uint8_t reel_gray[4] = { 0, 1, 3, 2 };
+
+uint8_t reel_port = 0xFF;                       // Port 2 before REEL_POLARITY
+uint8_t reel_phase[REEL_COUNT];                 // gray index, reels_release() syncs it
+uint8_t reel_pos[REEL_COUNT];                   // 0 .. REEL_STEPS_REV-1
+uint8_t reel_target[REEL_COUNT];
+volatile uint16_t reel_left[REEL_COUNT];        // steps still to go, 0 = standing
+uint8_t reel_ramp[REEL_COUNT];                  // index into reel_ramp_ticks
+uint8_t reel_top[REEL_COUNT] = { 5, 5, 5 };     // highest ramp index, 5 = 4 ticks per step
+uint8_t reel_wait[REEL_COUNT];                  // ticks to the next step
+uint8_t* reel_capture_buf[REEL_COUNT];          // optic samples, one bit per step
+uint16_t reel_done[REEL_COUNT];                 // steps since reel_capture()
+uint8_t reel_capture_pos[REEL_COUNT];           // position of sample 0
+
+uint8_t reel_sig[REEL_COUNT][REEL_SIG_BYTES];   // optic at each position, bit n = position n
+uint8_t reel_window[REEL_COUNT];                // unique window length, 0 = not learned
+uint8_t reel_homed = 0;                         // bit w set while reel_pos[w] is absolute
+uint8_t reel_home_buf[REEL_COUNT][REEL_SIG_BYTES];
+uint8_t reel_home_top[REEL_COUNT];              // speed to restore after homing
+uint8_t reel_homing = 0;                        // bit w set from reel_home_start() to reel_home_finish()
+
+#define REEL_REPEATS        0xFF    // reel_window_scan(): no window is unique
+#define REEL_FAULT_LIMIT    2       // wrong samples without a good edge before a reel is out of step
+
+uint8_t reel_bad[REEL_COUNT];                   // wrong samples since the last good edge
+uint16_t reel_missed[REEL_COUNT];               // edges seen a step late, since start-up
+uint16_t reel_extra[REEL_COUNT];                // edges seen a step early
+volatile uint8_t reel_fault = 0;                // bit w set: reel w lost step, not handled yet
+
+/**
+ * @brief Read one bit of a sample buffer
+ *
+ * @param bits Samples, LSB first
+ * @param n Bit number
+ * @return bool The sample
+ */
+bool reel_bit(const uint8_t* bits, uint16_t n) {
+    return (bits[n >> 3] & (1 << (n & 7))) != 0;
+}
+
+/**
+ * @brief Compare the optic of a homed reel with its signature
+ *
+ * A sample that disagrees at an edge of the signature means the edge has
+ * not come yet, the reel is behind (missed step); one that disagrees just
+ * before an edge means the edge came early (extra step). Either way, or
+ * for any other wrong sample, once REEL_FAULT_LIMIT samples have been
+ * wrong without a good edge in between the reel is out of step: it is no
+ * longer homed and its reel_fault bit is set for the main code.
+ *
+ * @param w Reel 0..2
+ * @param seen Optic at the current position
+ */
+void reel_check(uint8_t w, bool seen) {
+    uint8_t pos = reel_pos[w];
+    bool expect = reel_bit(reel_sig[w], pos);
+    bool edge = expect != reel_bit(reel_sig[w], pos ? pos - 1 : REEL_STEPS_REV - 1);
+
+    if (seen == expect) {
+        if (edge)
+            reel_bad[w] = 0;
+        return;
+    }
+    if (edge)
+        reel_missed[w]++;
+    else if (reel_bit(reel_sig[w], pos + 1 == REEL_STEPS_REV ? 0 : pos + 1) != expect)
+        reel_extra[w]++;
+    if (++reel_bad[w] >= REEL_FAULT_LIMIT) {
+        reel_homed &= ~(1 << w);
+        reel_fault |= 1 << w;
+    }
+}
+
+/**
+ * @brief Make one step with a reel and plan the next one
+ *
+ * Samples the optic first, when the rotor has stood still for the whole
+ * step time, to record it and to check a homed reel. Only updates
+ * reel_port, the caller writes it.
+ *
+ * @param w Reel 0..2
+ * @param optic Port 1 as read in this tick
+ */
+void reel_step(uint8_t w, uint8_t optic) {
+    uint8_t shift = (uint8_t)(w * 2);
+
+    optic &= 1 << w;
+
+    if (reel_homed & (1 << w))
+        reel_check(w, optic != 0);
+    if (reel_capture_buf[w] && optic)
+        reel_capture_buf[w][reel_done[w] >> 3] |= (uint8_t)(1 << (reel_done[w] & 7));
+    reel_done[w]++;
+
+    reel_phase[w] = (reel_phase[w] + 1) & 3;
+    reel_port = (reel_port & ~(3 << shift)) | (reel_gray[reel_phase[w]] << shift);
+    if (++reel_pos[w] == REEL_STEPS_REV)
+        reel_pos[w] = 0;
+
+    if (--reel_left[w] == 0)
+        return;
+    if (reel_left[w] <= reel_ramp[w])
+        reel_ramp[w]--;                 // just enough steps left to slow down
+    else if (reel_ramp[w] < reel_top[w])
+        reel_ramp[w]++;
+    reel_wait[w] = reel_ramp_ticks[reel_ramp[w]];
+}
+
+/**
+ * @brief Advance the reels by one timer tick
+ *
+ * Called from the timer 2 tick with interrupts disabled.
+ */
+void reel_tick() {
+    bool stepped = false;
+    uint8_t optic = 0;
+    bool sampled = false;
+
+    for (uint8_t w = 0; w < REEL_COUNT; w++) {
+        if (!reel_left[w] || --reel_wait[w])
+            continue;
+        if (!sampled) {
+            optic = read_port1();       // one read serves all reels stepping now
+            sampled = true;
+        }
+        reel_step(w, optic);
+        stepped = true;
+    }
+    if (stepped)
+        set_port2(reel_port ^ REEL_POLARITY);
+}
+
+/**
+ * @brief Turn a reel forward by a number of steps
+ *
+ * A standing reel starts on the next tick. A moving reel keeps its speed;
+ * if the new distance is too short to slow down in, the move is as short as
+ * the ramp allows instead.
+ *
+ * @param w Reel 0..2
+ * @param steps Steps to go
+ */
+void reel_move(uint8_t w, uint16_t steps) {
+    uint8_t irq = irq_save();
+    if (!reel_left[w]) {
+        reel_ramp[w] = 0;
+        reel_wait[w] = 1;
+    } else if (steps < reel_ramp[w]) {
+        steps = reel_ramp[w];
+    }
+    reel_left[w] = steps;
+    reel_target[w] = (uint8_t)((reel_pos[w] + steps) % REEL_STEPS_REV);
+    irq_restore(irq);
+}
+
+/**
+ * @brief Turn a reel forward to a position
+ *
+ * A moving reel that is too close to the target to slow down goes round
+ * once more, so it still ends on the target.
+ *
+ * @param w Reel 0..2
+ * @param pos Target position 0 .. REEL_STEPS_REV-1
+ * @param turns Extra full revolutions on the way
+ */
+void reel_goto(uint8_t w, uint8_t pos, uint8_t turns) {
+    uint8_t irq = irq_save();
+    uint16_t steps = (uint16_t)((pos + REEL_STEPS_REV - reel_pos[w]) % REEL_STEPS_REV)
+                   + (uint16_t)turns * REEL_STEPS_REV;
+    if (reel_left[w]) {
+        while (steps < reel_ramp[w])
+            steps += REEL_STEPS_REV;
+    }
+    reel_move(w, steps);
+    irq_restore(irq);
+}
+
+/**
+ * @brief Set the full speed of a reel
+ *
+ * Takes effect on the next step. Slower than the first ramp entry is not
+ * possible, the reel then runs at that entry all the way.
+ *
+ * @param w Reel 0..2
+ * @param ticks Ticks per step at full speed
+ */
+void reel_set_speed(uint8_t w, uint8_t ticks) {
+    uint8_t top = 0;
+    while (top + 1 < REEL_RAMP_LEN && reel_ramp_ticks[top + 1] >= ticks)
+        top++;
+    reel_top[w] = top;
+}
+
+/**
+ * @brief Record the optic of a reel for every step from now on
+ *
+ * Bit n of buf (LSB first) is the optic before step n, the caller clears
+ * buf and makes it large enough for the move.
+ *
+ * @param w Reel 0..2
+ * @param buf Sample buffer, 0 to stop recording
+ */
+void reel_capture(uint8_t w, uint8_t* buf) {
+    uint8_t irq = irq_save();
+    reel_capture_buf[w] = buf;
+    reel_done[w] = 0;
+    reel_capture_pos[w] = reel_pos[w];
+    irq_restore(irq);
+}
+
+/**
+ * @brief Slow a reel down and stop it as soon as the ramp allows
+ *
+ * @param w Reel 0..2
+ */
+void reel_stop(uint8_t w) {
+    uint8_t irq = irq_save();
+    if (reel_left[w] > reel_ramp[w] + 1)
+        reel_left[w] = reel_ramp[w] + 1;
+    irq_restore(irq);
+}
+
+/**
+ * @brief Check whether a reel is still turning
+ *
+ * @param w Reel 0..2
+ * @return bool true until the reel has made its last step
+ */
+bool reel_busy(uint8_t w) {
+    return reel_left[w] != 0;
+}
+
+/**
+ * @brief Stop all reels at once and idle the coils
+ *
+ * The phases are set to match the idle 0xFF on Port 2, so the next move
+ * starts from where the rotor is held. A reel that was still moving, or
+ * that stood on another phase and is pulled over to the idle one, has to
+ * be homed again; a homing run in progress fails. Also called once at
+ * start-up to sync the engine.
+ */
+void reels_release() {
+    uint8_t irq = irq_save();
+    reel_port = 0xFF ^ REEL_POLARITY;
+    for (uint8_t w = 0; w < REEL_COUNT; w++) {
+        uint8_t phase = reel_gray[(reel_port >> (w * 2)) & 3];
+        if (reel_left[w] || reel_phase[w] != phase)
+            reel_homed &= ~(1 << w);
+        reel_left[w] = 0;
+        reel_phase[w] = phase;
+        reel_capture_buf[w] = 0;
+    }
+    reel_homing = 0;
+    set_port2(0xFF);
+    irq_restore(irq);
+}
+
+/**
+ * @brief Forget a reported fault of a reel
+ *
+ * @param w Reel 0..2
+ */
+void reel_clear_fault(uint8_t w) {
+    uint8_t irq = irq_save();
+    reel_fault &= ~(1 << w);
+    irq_restore(irq);
+}
+
+/**
+ * @brief Compare one start position with every later one on the disc
+ *
+ * Any two start positions share a run of equal samples; one more sample
+ * than the longest such run tells every position apart. A full search is
+ * REEL_STEPS_REV^2 / 2 pairs, so it is done one start position per call:
+ * call this for i = 0 .. REEL_STEPS_REV - 2 with longest starting at 0,
+ * then hand the result to reel_set_window().
+ *
+ * @param w Reel 0..2
+ * @param i Start position
+ * @param longest Longest run found so far
+ * @return uint8_t Longest run including start i, REEL_REPEATS if the disc
+ *         repeats itself
+ */
+uint8_t reel_window_scan(uint8_t w, uint8_t i, uint8_t longest) {
+    for (uint8_t j = i + 1; j < REEL_STEPS_REV; j++) {
+        uint8_t a = i, b = j, run = 0;
+        while (run < REEL_STEPS_REV && reel_bit(reel_sig[w], a) == reel_bit(reel_sig[w], b)) {
+            run++;
+            if (++a == REEL_STEPS_REV) a = 0;
+            if (++b == REEL_STEPS_REV) b = 0;
+        }
+        if (run == REEL_STEPS_REV)
+            return REEL_REPEATS;
+        if (run > longest)
+            longest = run;
+    }
+    return longest;
+}
+
+/**
+ * @brief Finish learning a wheel once reel_window_scan() has seen every start
+ *
+ * @param w Reel 0..2
+ * @param longest Result of the last reel_window_scan()
+ * @return uint8_t Unique window length, 0 if the disc repeats itself
+ */
+uint8_t reel_set_window(uint8_t w, uint8_t longest) {
+    reel_window[w] = (longest == REEL_REPEATS) ? 0 : longest + 1;
+    reel_bad[w] = 0;
+    reel_clear_fault(w);
+    if (reel_window[w])
+        reel_homed |= 1 << w;
+    return reel_window[w];
+}
+
+/**
+ * @brief Learn the signature of a wheel from a recorded move
+ *
+ * The samples must come from reel_capture() and cover at least two
+ * revolutions. Every further revolution has to agree with the first, else
+ * steps were lost or the optic is noisy. The current position numbering
+ * becomes absolute. The reel counts as learned once reel_window_scan() and
+ * reel_set_window() have found its unique window.
+ *
+ * @param w Reel 0..2
+ * @param bits Samples from reel_capture()
+ * @param count Number of samples
+ * @return bool true if the signature was taken
+ */
+bool reel_learn(uint8_t w, const uint8_t* bits, uint16_t count) {
+    uint8_t pos = reel_capture_pos[w];
+
+    reel_window[w] = 0;
+    reel_homed &= ~(1 << w);
+    if (count < 2 * REEL_STEPS_REV)
+        return false;
+    for (uint16_t n = REEL_STEPS_REV; n < count; n++) {
+        if (reel_bit(bits, n) != reel_bit(bits, n - REEL_STEPS_REV))
+            return false;
+    }
+
+    memset(reel_sig[w], 0, REEL_SIG_BYTES);
+    for (uint8_t n = 0; n < REEL_STEPS_REV; n++) {
+        if (reel_bit(bits, n))
+            reel_sig[w][pos >> 3] |= (uint8_t)(1 << (pos & 7));
+        if (++pos == REEL_STEPS_REV)
+            pos = 0;
+    }
+    return true;
+}
+
+/**
+ * @brief Start homing a reel
+ *
+ * Steps the reel through one unique window at the slow end of the ramp,
+ * recording the optic. Call reel_home_finish() once reel_busy() is false.
+ *
+ * @param w Reel 0..2
+ * @return bool false if the wheel has no signature yet, is moving or is
+ *         already being homed
+ */
+bool reel_home_start(uint8_t w) {
+    if (!reel_window[w] || reel_busy(w) || (reel_homing & (1 << w)))
+        return false;
+    reel_homing |= 1 << w;
+    reel_homed &= ~(1 << w);
+    memset(reel_home_buf[w], 0, REEL_SIG_BYTES);
+    reel_home_top[w] = reel_top[w];
+    reel_top[w] = 0;
+    reel_capture(w, reel_home_buf[w]);
+    reel_move(w, reel_window[w]);
+    return true;
+}
+
+/**
+ * @brief Find the position of a reel from the homing samples
+ *
+ * @param w Reel 0..2
+ * @return bool true if the samples match the signature, the reel is homed;
+ *         false also if reels_release() cut the run short
+ */
+bool reel_home_finish(uint8_t w) {
+    uint8_t k = reel_window[w];
+
+    reel_capture(w, 0);
+    reel_top[w] = reel_home_top[w];
+    if (!(reel_homing & (1 << w)))
+        return false;
+    reel_homing &= ~(1 << w);
+    if (!k)
+        return false;
+    for (uint8_t j = 0; j < REEL_STEPS_REV; j++) {
+        uint8_t n, p = j;
+        for (n = 0; n < k; n++) {
+            if (reel_bit(reel_home_buf[w], n) != reel_bit(reel_sig[w], p))
+                break;
+            if (++p == REEL_STEPS_REV) p = 0;
+        }
+        if (n == k) {
+            reel_pos[w] = p;
+            reel_bad[w] = 0;
+            reel_clear_fault(w);
+            reel_homed |= 1 << w;
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
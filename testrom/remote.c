@@ -0,0 +1,402 @@
+/**
+ * @file remote.c
+ * @brief Framed binary remote control over the 8256 serial link
+ *
+ * Lets a host script run the service menu tests, peek/poke memory and do
+ * port I/O without anybody pressing buttons on the cabinet. Frames share the
+ * serial line with the text console: a frame starts with STX, which never
+ * appears in typed text, so the line editor hands those bytes over here.
+ *
+ * Frame layout (both directions):
+ *
+ *   STX | SEQ | CMD | LEN | DATA[LEN] | CRC_HI | CRC_LO
+ *
+ * The CRC is CRC-16/CCITT (poly 0x1021, init 0xFFFF) over SEQ..DATA.
+ * A reply echoes SEQ, sets bit 7 of CMD and starts DATA with a status byte.
+ * Capture data from the tests in binary mode goes out unsolicited as
+ * REMOTE_BLOCK_* frames with their own running SEQ and no status byte.
+ * Multi-byte values are little-endian. See remote.py for the host side and
+ * capture.py for the block decoder.
+ *
+ * A request with a bad CRC is answered with REMOTE_BAD_CRC, its SEQ and CMD
+ * as received; a request cut off or with an impossible LEN gets no answer.
+ * Either way the host sends the same frame again, with the same SEQ. The
+ * board remembers the SEQ, CMD and short reply of the last request it
+ * executed, so a repeat of a request that changes something (RUN, POKE,
+ * OUT, ...) whose reply got lost is only answered again, not executed
+ * twice; a repeated RUN whose test is still running is ignored. PING, PEEK
+ * and RESULT only read, they are simply executed again. A new request
+ * therefore needs a new SEQ.
+ *
+ * @author stonedDiscord
+ * @date 17.10.2026
+ */
+#ifndef HEADER_REMOTE
+#define HEADER_REMOTE
+
+#define REMOTE_STX      0x02
+// REMOTE_MAX_DATA is set per board in main.c
+#define REMOTE_VERSION  3
+
+enum REMOTE_CMD {
+    REMOTE_PING   = 0x00,   // -> version, menu item count
+    REMOTE_RUN    = 0x01,   // item -> result code, replied when the test ends
+    REMOTE_PEEK   = 0x02,   // addr16, count -> bytes
+    REMOTE_POKE   = 0x03,   // addr16, bytes...
+    REMOTE_IN     = 0x04,   // port -> value
+    REMOTE_OUT    = 0x05,   // port, value
+    REMOTE_RESULT = 0x06,   // -> result code of every menu item
+    REMOTE_BAUD   = 0x07,   // baud_table index, reply sent at the old rate
+    REMOTE_BINARY = 0x08,   // 0/1: text or binary capture output
+    REMOTE_REPLY  = 0x80,
+};
+
+// Unsolicited capture blocks (binary mode)
+enum REMOTE_BLOCK {
+    REMOTE_BLOCK_DISC = 0x40,   // wheel, steps16, steps per rev, optic bits packed LSB first
+    REMOTE_BLOCK_REST = 0x41,   // rest state of sensor rows TZ0..TZ7
+    REMOTE_BLOCK_COIN = 0x42,   // entries of (index delta, TZ1 xor, TZ2 xor)
+};
+
+enum REMOTE_STATUS {
+    REMOTE_OK          = 0x00,
+    REMOTE_BAD_CMD     = 0x01,
+    REMOTE_BAD_LENGTH  = 0x02,
+    REMOTE_BAD_ARG     = 0x03,
+    REMOTE_BUSY        = 0x04,   // another test is still running
+    REMOTE_BAD_CRC     = 0x05,   // request damaged, send it again
+};
+
+enum REMOTE_STATE {
+    REMOTE_IDLE,
+    REMOTE_SEQ,
+    REMOTE_CMD_BYTE,
+    REMOTE_LEN,
+    REMOTE_DATA,
+    REMOTE_CRC_HI,
+    REMOTE_CRC_LO,
+};
+
+uint8_t remote_state = REMOTE_IDLE;
+uint8_t remote_seq;
+uint8_t remote_cmd;
+uint8_t remote_len;
+uint8_t remote_pos;
+uint16_t remote_crc;
+uint8_t remote_crc_hi;
+uint8_t remote_data[REMOTE_MAX_DATA];
+uint8_t remote_block_seq = 0;
+bool remote_run_pending = false;    // a RUN is waiting for its test to end
+uint8_t remote_run_seq;
+uint8_t remote_last_seq;                // last executed request, see the file comment
+uint8_t remote_last_cmd = 0xFF;         // no request yet
+uint8_t remote_last_status;
+uint8_t remote_last_len;                // 0 or 1
+uint8_t remote_last_data;
+
+// 8085 has no IN/OUT with a variable port, so the command is assembled here
+uint8_t remote_io_stub[6];
+
+/**
+ * @brief Feed one byte into a CRC-16/CCITT
+ *
+ * Table-free form that handles the byte with four shifts instead of a
+ * loop over its bits, so no table is needed in ROM.
+ *
+ * @param crc Running CRC
+ * @param data Next byte
+ * @return uint16_t Updated CRC
+ */
+uint16_t crc16_update(uint16_t crc, uint8_t data) {
+    uint8_t x = (uint8_t)(crc >> 8) ^ data;
+    x ^= x >> 4;
+    return (crc << 8) ^ ((uint16_t)x << 12) ^ ((uint16_t)x << 5) ^ x;
+}
+
+/**
+ * @brief Send a byte and add it to a running CRC
+ */
+uint16_t remote_put(uint16_t crc, uint8_t data) {
+    print_serial_char(data);
+    return crc16_update(crc, data);
+}
+
+/**
+ * @brief Send one frame
+ *
+ * The payload is sent as a short header followed by the data, so callers
+ * can prefix a status byte or block header without copying the data.
+ *
+ * @param seq Sequence number
+ * @param cmd Command or block type
+ * @param head Header bytes
+ * @param head_len Number of header bytes
+ * @param data Data following the header
+ * @param len Number of data bytes
+ */
+void remote_send(uint8_t seq, uint8_t cmd, const uint8_t* head, uint8_t head_len,
+                 const uint8_t* data, uint8_t len) {
+    uint16_t crc = 0xFFFF;
+    print_serial_char(REMOTE_STX);
+    crc = remote_put(crc, seq);
+    crc = remote_put(crc, cmd);
+    crc = remote_put(crc, head_len + len);
+    for (uint8_t i = 0; i < head_len; i++)
+        crc = remote_put(crc, head[i]);
+    for (uint8_t i = 0; i < len; i++)
+        crc = remote_put(crc, data[i]);
+    print_serial_char(crc >> 8);
+    print_serial_char(crc & 0xFF);
+}
+
+/**
+ * @brief Send a reply and remember it for a repeated request
+ *
+ * Only replies of at most one payload byte are kept, the longer ones come
+ * from the read-only commands that are executed again instead.
+ *
+ * @param seq Sequence number of the request
+ * @param cmd Command of the request
+ * @param status Status byte (REMOTE_OK or an error)
+ * @param data Payload following the status byte
+ * @param len Payload length
+ */
+void remote_answer(uint8_t seq, uint8_t cmd, uint8_t status, const uint8_t* data, uint8_t len) {
+    remote_last_seq = seq;
+    remote_last_cmd = cmd;
+    remote_last_status = status;
+    remote_last_len = len ? 1 : 0;
+    remote_last_data = len ? data[0] : 0;
+    remote_send(seq, cmd | REMOTE_REPLY, &status, 1, data, len);
+}
+
+/**
+ * @brief Send a reply frame for the command currently being handled
+ *
+ * @param status Status byte (REMOTE_OK or an error)
+ * @param data Payload following the status byte
+ * @param len Payload length
+ */
+void remote_reply(uint8_t status, const uint8_t* data, uint8_t len) {
+    remote_answer(remote_seq, remote_cmd, status, data, len);
+}
+
+/**
+ * @brief Send an unsolicited capture block
+ *
+ * @param type REMOTE_BLOCK_* type
+ * @param head Block header
+ * @param head_len Header length
+ * @param data Block data
+ * @param len Data length (head_len + len must not exceed REMOTE_MAX_DATA)
+ */
+void remote_block(uint8_t type, const uint8_t* head, uint8_t head_len,
+                  const uint8_t* data, uint8_t len) {
+    remote_send(remote_block_seq++, type, head, head_len, data, len);
+}
+
+/**
+ * @brief Read an I/O port chosen at runtime
+ */
+uint8_t remote_port_in(uint8_t port) {
+    remote_io_stub[0] = 0xDB;       // IN port
+    remote_io_stub[1] = port;
+    remote_io_stub[2] = 0x6F;       // MOV L,A
+    remote_io_stub[3] = 0x26;       // MVI H,0
+    remote_io_stub[4] = 0x00;
+    remote_io_stub[5] = 0xC9;       // RET
+    return ((uint8_t (*)())remote_io_stub)();
+}
+
+/**
+ * @brief Write an I/O port chosen at runtime
+ */
+void remote_port_out(uint8_t port, uint8_t value) {
+    remote_io_stub[0] = 0x3E;       // MVI A,value
+    remote_io_stub[1] = value;
+    remote_io_stub[2] = 0xD3;       // OUT port
+    remote_io_stub[3] = port;
+    remote_io_stub[4] = 0xC9;       // RET
+    ((void (*)())remote_io_stub)();
+}
+
+/**
+ * @brief Send the deferred reply to a RUN once its test has ended
+ *
+ * @param item Menu item of the test that ended
+ */
+void remote_test_done(uint8_t item) {
+    if (!remote_run_pending)
+        return;
+    remote_run_pending = false;
+    remote_answer(remote_run_seq, REMOTE_RUN, REMOTE_OK, &test_result[item], 1);
+}
+
+/**
+ * @brief Execute a complete, CRC-checked frame
+ *
+ * A repeat of the last request is answered from the remembered reply
+ * instead, unless it only reads.
+ */
+void remote_dispatch() {
+    uint8_t* d = remote_data;
+    uint8_t reply[2];
+
+    if (remote_cmd != REMOTE_PING && remote_cmd != REMOTE_PEEK && remote_cmd != REMOTE_RESULT) {
+        if (remote_run_pending && remote_cmd == REMOTE_RUN && remote_seq == remote_run_seq)
+            return;                     // still running, the reply comes from remote_test_done()
+        if (remote_seq == remote_last_seq && remote_cmd == remote_last_cmd) {
+            remote_send(remote_seq, remote_cmd | REMOTE_REPLY, &remote_last_status, 1,
+                        &remote_last_data, remote_last_len);
+            return;
+        }
+    }
+
+    switch (remote_cmd) {
+        case REMOTE_PING:
+            reply[0] = REMOTE_VERSION;
+            reply[1] = MENU_ITEMS;
+            remote_reply(REMOTE_OK, reply, 2);
+            return;
+
+        case REMOTE_RUN:
+            if (remote_len != 1) break;
+            if (d[0] >= MENU_ITEMS) {
+                remote_reply(REMOTE_BAD_ARG, 0, 0);
+                return;
+            }
+            if (test_running()) {
+                remote_reply(REMOTE_BUSY, 0, 0);
+                return;
+            }
+            run_menu_item(d[0]);
+            if (test_running()) {
+                remote_run_seq = remote_seq;    // reply from remote_test_done()
+                remote_run_pending = true;
+                return;
+            }
+            remote_reply(REMOTE_OK, &test_result[d[0]], 1);
+            return;
+
+        case REMOTE_PEEK:
+            if (remote_len != 3) break;
+            if (d[2] > REMOTE_MAX_DATA - 1) {
+                remote_reply(REMOTE_BAD_ARG, 0, 0);
+                return;
+            }
+            remote_reply(REMOTE_OK, (const uint8_t*)(d[0] | (d[1] << 8)), d[2]);
+            return;
+
+        case REMOTE_POKE:
+            if (remote_len < 2) break;
+            {
+                uint8_t* p = (uint8_t*)(d[0] | (d[1] << 8));
+                for (uint8_t i = 2; i < remote_len; i++)
+                    *p++ = d[i];
+            }
+            remote_reply(REMOTE_OK, 0, 0);
+            return;
+
+        case REMOTE_IN:
+            if (remote_len != 1) break;
+            reply[0] = remote_port_in(d[0]);
+            remote_reply(REMOTE_OK, reply, 1);
+            return;
+
+        case REMOTE_OUT:
+            if (remote_len != 2) break;
+            remote_port_out(d[0], d[1]);
+            remote_reply(REMOTE_OK, 0, 0);
+            return;
+
+        case REMOTE_RESULT:
+            if (remote_len != 0) break;
+            remote_reply(REMOTE_OK, test_result, MENU_ITEMS);
+            return;
+
+        case REMOTE_BAUD:
+            if (remote_len != 1) break;
+            if (d[0] >= BAUD_COUNT) {
+                remote_reply(REMOTE_BAD_ARG, 0, 0);
+                return;
+            }
+            remote_reply(REMOTE_OK, 0, 0);
+            set_baud(d[0]);
+            settings_save();
+            return;
+
+        case REMOTE_BINARY:
+            if (remote_len != 1) break;
+            capture_binary = d[0] != 0;
+            remote_reply(REMOTE_OK, 0, 0);
+            return;
+
+        default:
+            remote_reply(REMOTE_BAD_CMD, 0, 0);
+            return;
+    }
+    remote_reply(REMOTE_BAD_LENGTH, 0, 0);
+}
+
+/**
+ * @brief Offer a received byte to the frame parser
+ *
+ * @param c Byte from the receive queue
+ * @param start_ok true if an STX may start a new frame here (not mid-line)
+ * @return bool true if the byte belonged to a frame and was consumed
+ */
+bool remote_rx_byte(uint8_t c, bool start_ok) {
+    switch (remote_state) {
+        case REMOTE_IDLE:
+            if (c != REMOTE_STX || !start_ok)
+                return false;
+            remote_crc = 0xFFFF;
+            remote_state = REMOTE_SEQ;
+            return true;
+
+        case REMOTE_SEQ:
+            remote_seq = c;
+            remote_state = REMOTE_CMD_BYTE;
+            break;
+
+        case REMOTE_CMD_BYTE:
+            remote_cmd = c;
+            remote_state = REMOTE_LEN;
+            break;
+
+        case REMOTE_LEN:
+            if (c > REMOTE_MAX_DATA) {
+                remote_state = REMOTE_IDLE;     // cannot be a frame, resync
+                return true;
+            }
+            remote_len = c;
+            remote_pos = 0;
+            remote_state = c ? REMOTE_DATA : REMOTE_CRC_HI;
+            break;
+
+        case REMOTE_DATA:
+            remote_data[remote_pos++] = c;
+            if (remote_pos == remote_len)
+                remote_state = REMOTE_CRC_HI;
+            break;
+
+        case REMOTE_CRC_HI:
+            remote_crc_hi = c;
+            remote_state = REMOTE_CRC_LO;
+            return true;
+
+        case REMOTE_CRC_LO:
+            remote_state = REMOTE_IDLE;
+            if (remote_crc_hi == (remote_crc >> 8) && c == (remote_crc & 0xFF)) {
+                remote_dispatch();
+            } else {
+                uint8_t status = REMOTE_BAD_CRC;    // not remembered, the repeat must run
+                remote_send(remote_seq, remote_cmd | REMOTE_REPLY, &status, 1, 0, 0);
+            }
+            return true;
+    }
+    remote_crc = crc16_update(remote_crc, c);
+    return true;
+}
+
+#endif
@@ -0,0 +1,251 @@
+#!/usr/bin/env python3
+"""
+Remote control for the Test ROM over the 8256 serial link
+
+This script talks the framed binary protocol implemented in remote.c, so a
+bench rig can run the service menu tests unattended and read back results.
+
+Usage:
+    python3 remote.py <port> ping
+    python3 remote.py <port> run <item> [<item> ...]
+    python3 remote.py <port> suite
+    python3 remote.py <port> results
+    python3 remote.py <port> peek <addr> <count>
+    python3 remote.py <port> poke <addr> <byte> [<byte> ...]
+    python3 remote.py <port> in <port>
+    python3 remote.py <port> out <port> <value>
+    python3 remote.py <port> baud <rate>
+    python3 remote.py <port> autobaud <rate>
+
+Add --baud=<rate> before the port if the board is not at 4800 baud.
+
+Example:
+    python3 remote.py /dev/ttyUSB0 suite
+
+Numbers may be given in decimal or with a 0x prefix. Text printed by the
+tests between frames is passed through to stdout.
+
+A request that gets BAD_CRC or no reply is sent again with the same
+sequence number, up to RETRIES times. The board answers a repeat of its
+last request without executing it twice (see remote.c).
+"""
+
+import sys
+import time
+import serial
+
+STX = 0x02
+REPLY = 0x80
+
+CMD_PING = 0x00
+CMD_RUN = 0x01
+CMD_PEEK = 0x02
+CMD_POKE = 0x03
+CMD_IN = 0x04
+CMD_OUT = 0x05
+CMD_RESULT = 0x06
+CMD_BAUD = 0x07
+CMD_BINARY = 0x08
+
+# Same order as baud_table in main.c
+baud_rates = [2400, 4800, 9600, 19200, 38400]
+
+status_names = ['OK', 'BAD_CMD', 'BAD_LENGTH', 'BAD_ARG', 'BUSY', 'BAD_CRC']
+STATUS_BAD_CRC = 5
+RETRIES = 3
+result_names = ['NONE', 'DONE', 'PASS', 'FAIL', 'CANCELLED', 'RUNNING']
+
+# Menu items that make sense to run unattended (see run_menu_item in main.c)
+suite_items = {
+    8: '8256 timer',
+    9: '8279 display RAM',
+    10: 'RAM size',
+    11: 'RTC',
+}
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/CCITT as computed by crc16_update() in remote.c"""
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+def build_frame(seq, cmd, data=b''):
+    """Build a request frame"""
+    body = bytes([seq & 0xFF, cmd, len(data)]) + bytes(data)
+    crc = crc16(body)
+    return bytes([STX]) + body + bytes([crc >> 8, crc & 0xFF])
+
+class FrameReader:
+    """Pull frames out of the serial stream, passing other text through"""
+
+    def __init__(self, port, echo=sys.stdout):
+        self.port = port
+        self.echo = echo
+
+    def read_byte(self):
+        b = self.port.read(1)
+        if not b:
+            raise TimeoutError("no reply from board")
+        return b[0]
+
+    def read_frame(self):
+        """Return (seq, cmd, data) of the next frame with a valid CRC"""
+        while True:
+            b = self.read_byte()
+            if b != STX:
+                if self.echo:
+                    self.echo.write(chr(b))
+                    self.echo.flush()
+                continue
+            seq, cmd, length = self.read_byte(), self.read_byte(), self.read_byte()
+            data = bytes(self.read_byte() for _ in range(length))
+            crc = (self.read_byte() << 8) | self.read_byte()
+            if crc == crc16(bytes([seq, cmd, length]) + data):
+                return seq, cmd, data
+
+class Board:
+    """One Test ROM reachable over a serial port"""
+
+    def __init__(self, device, baud=4800, timeout=30):
+        self.port = serial.Serial(device, baud, timeout=timeout)
+        self.reader = FrameReader(self.port)
+        self.seq = 0
+
+    def request(self, cmd, data=b''):
+        self.seq = (self.seq + 1) & 0xFF
+        frame = build_frame(self.seq, cmd, data)
+        for attempt in range(RETRIES + 1):
+            self.port.write(frame)
+            try:
+                while True:
+                    seq, rcmd, rdata = self.reader.read_frame()
+                    if seq == self.seq and rcmd == (cmd | REPLY):
+                        break
+            except TimeoutError:
+                if attempt == RETRIES:
+                    raise
+                continue
+            if rdata[0] != STATUS_BAD_CRC or attempt == RETRIES:
+                break
+        status = rdata[0]
+        if status != 0:
+            name = status_names[status] if status < len(status_names) else hex(status)
+            raise RuntimeError(f"board replied {name}")
+        return rdata[1:]
+
+    def ping(self):
+        version, items = self.request(CMD_PING)
+        return version, items
+
+    def run(self, item):
+        return self.request(CMD_RUN, bytes([item]))[0]
+
+    def results(self):
+        return list(self.request(CMD_RESULT))
+
+    def peek(self, addr, count):
+        return self.request(CMD_PEEK, bytes([addr & 0xFF, addr >> 8, count]))
+
+    def poke(self, addr, data):
+        self.request(CMD_POKE, bytes([addr & 0xFF, addr >> 8]) + bytes(data))
+
+    def port_in(self, port):
+        return self.request(CMD_IN, bytes([port]))[0]
+
+    def port_out(self, port, value):
+        self.request(CMD_OUT, bytes([port, value]))
+
+    def set_binary(self, on):
+        self.request(CMD_BINARY, bytes([1 if on else 0]))
+
+    def set_baud(self, rate):
+        self.request(CMD_BAUD, bytes([baud_rates.index(rate)]))
+        self.port.flush()
+        self.port.baudrate = rate
+
+    def autobaud(self, rate, timeout=12):
+        """Move the board to a new rate through its AUTOBAUD console command
+
+        Follows the handshake in autobaud() in main.c: wait for the prompt,
+        switch to the new rate, send 'U' until the board answers with
+        "baud <rate>", then stop. Goes back to the old rate and raises if
+        the board does not answer in time.
+        """
+        old = self.port.baudrate
+        self.port.reset_input_buffer()
+        self.port.write(b'\rAUTOBAUD\r')
+        seen = self.port.read_until(b'new rate\n')
+        if not seen.endswith(b'new rate\n'):
+            raise TimeoutError("board did not start autobaud")
+        self.port.baudrate = rate
+        answer = f"baud {rate}\n".encode()
+        got = b''
+        deadline = time.monotonic() + timeout
+        while answer not in got:
+            if time.monotonic() > deadline:
+                self.port.baudrate = old
+                raise TimeoutError("board did not lock onto the new rate")
+            self.port.write(b'U' * 8)
+            self.port.flush()           # keep the backlog short, the board stops listening soon after its answer
+            got = (got + self.port.read(self.port.in_waiting))[-64:]
+        time.sleep(0.6)                 # longer than AUTOBAUD_DRAIN
+        self.port.reset_input_buffer()
+
+def result_name(code):
+    return result_names[code] if code < len(result_names) else hex(code)
+
+def main():
+    argv = sys.argv[1:]
+    baud = 4800
+    if argv and argv[0].startswith('--baud='):
+        baud = int(argv.pop(0).split('=', 1)[1])
+
+    if len(argv) < 2:
+        print(__doc__)
+        sys.exit(1)
+
+    board = Board(argv[0], baud)
+    command = argv[1]
+    args = [int(a, 0) for a in argv[2:]]
+
+    if command == 'ping':
+        version, items = board.ping()
+        print(f"protocol v{version}, {items} menu items")
+    elif command == 'run':
+        for item in args:
+            print(f"\nitem {item}: {result_name(board.run(item))}")
+    elif command == 'suite':
+        failed = False
+        for item, name in suite_items.items():
+            result = board.run(item)
+            failed |= result_name(result) not in ('PASS', 'DONE')
+            print(f"\n{name}: {result_name(result)}")
+        sys.exit(1 if failed else 0)
+    elif command == 'results':
+        for item, code in enumerate(board.results()):
+            print(f"{item:2}: {result_name(code)}")
+    elif command == 'peek':
+        data = board.peek(args[0], args[1])
+        for i in range(0, len(data), 16):
+            print(f"{args[0] + i:04X}: " + ' '.join(f"{b:02X}" for b in data[i:i + 16]))
+    elif command == 'poke':
+        board.poke(args[0], args[1:])
+    elif command == 'in':
+        print(f"{board.port_in(args[0]):02X}")
+    elif command == 'out':
+        board.port_out(args[0], args[1])
+    elif command == 'baud':
+        board.set_baud(args[0])
+        print(f"board now at {args[0]} baud")
+    elif command == 'autobaud':
+        board.autobaud(args[0])
+        print(f"board now at {args[0]} baud")
+    else:
+        print(__doc__)
+        sys.exit(1)
+
+if __name__ == "__main__":
+    main()
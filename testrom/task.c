@@ -0,0 +1,106 @@
+/**
+ * @file task.c
+ * @brief Cooperative task scheduler with protothread-style tasks
+ *
+ * Every task is a function that runs until it has to wait, then returns to
+ * the scheduler. The place to resume is kept in the task's local
+ * continuation (lc), a source line number that PT_BEGIN switches on, so a
+ * task can be written as straight-line code with PT_SLEEP and PT_WAIT_UNTIL
+ * in the middle of loops.
+ *
+ * Rules for task bodies:
+ *  - Locals do not survive a wait, and sccz80 allocates them where they are
+ *    declared, so jumping back in past a declaration would corrupt the
+ *    stack. A task body must only use static variables; put longer
+ *    synchronous work in a helper function, which may use locals.
+ *  - Do not use a switch statement inside a task body, the PT_* macros
+ *    expand to case labels.
+ *  - Never wait in a busy loop, yield instead.
+ *
+ * @author stonedDiscord
+ * @date 17.10.2026
+ */
+#ifndef HEADER_TASK
+#define HEADER_TASK
+
+#define TASK_MAX 6
+
+enum TASK_STATUS {
+    TASK_WAITING = 0,   // run again once the wake time has passed
+    TASK_DONE    = 1,   // finished, free the slot
+};
+
+struct task_t;
+typedef uint8_t (*task_fn)(struct task_t* t);
+
+struct task_t {
+    task_fn run;        // 0 = free slot
+    uint16_t lc;        // local continuation: line to resume at, 0 = start
+    uint16_t wake;      // millis16() when the task may run again
+};
+
+struct task_t tasks[TASK_MAX];
+
+#define PT_BEGIN(t)         switch ((t)->lc) { case 0:
+#define PT_END(t)           } (t)->lc = 0; return TASK_DONE;
+#define PT_EXIT(t)          do { (t)->lc = 0; return TASK_DONE; } while (0)
+
+// Let the other tasks run, then continue
+#define PT_YIELD(t)         do { (t)->lc = __LINE__; return TASK_WAITING; case __LINE__:; } while (0)
+
+// Sleep until an absolute millis16() deadline, for drift-free periodic work
+#define PT_SLEEP_UNTIL(t, deadline) \
+    do { (t)->wake = (deadline); (t)->lc = __LINE__; return TASK_WAITING; case __LINE__:; } while (0)
+
+// Sleep for ms milliseconds (at most 32767)
+#define PT_SLEEP(t, ms)     PT_SLEEP_UNTIL(t, millis16() + (ms))
+
+// Yield until cond is true, re-checked every scheduler pass
+#define PT_WAIT_UNTIL(t, cond) \
+    do { (t)->lc = __LINE__; case __LINE__: if (!(cond)) return TASK_WAITING; } while (0)
+
+/**
+ * @brief Start a task
+ *
+ * @param run Task function
+ * @return struct task_t* The task, or 0 if all slots are in use
+ */
+struct task_t* task_start(task_fn run) {
+    for (uint8_t i = 0; i < TASK_MAX; i++) {
+        struct task_t* t = &tasks[i];
+        if (!t->run) {
+            t->lc = 0;
+            t->wake = millis16();
+            t->run = run;
+            return t;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Stop a task wherever it is waiting
+ *
+ * @param t Task to stop
+ */
+void task_kill(struct task_t* t) {
+    t->run = 0;
+}
+
+/**
+ * @brief Give every task that is due one turn
+ *
+ * Call this from the main loop forever.
+ */
+void task_run_all() {
+    for (uint8_t i = 0; i < TASK_MAX; i++) {
+        struct task_t* t = &tasks[i];
+        if (t->run && deadline_passed(t->wake)) {
+            t->wake = millis16();       // due again next pass unless it sleeps
+            if (t->run(t) == TASK_DONE)
+                t->run = 0;
+        }
+    }
+}
+
+#endif
@@ -1,61 +1,103 @@
+// Packed track generated by parse.py, format described in music.h
 #include "music.h"
 
-const struct noteData track[] = {
-    { .note = NOTE_A, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "SA" },
-    { .note = NOTE_A, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "KU" },
-    { .note = NOTE_B, .octave = A7, .duration = DURATION_HALF,    .length = 200, .lyric = "RA " },
+const uint8_t track_notes[] = {
+    TRACK_NOTE(NOTE_A, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_ABS, 0, 77, // "SA"
+    TRACK_NOTE(NOTE_A, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(0), 1, // "KU"
+    TRACK_NOTE(NOTE_B, A7, DURATION_HALF), TRACK_LYRIC | TRACK_ABS, 2, 153, // "RA "
+    TRACK_NOTE(NOTE_A, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_ABS, 0, 77, // "SA"
+    TRACK_NOTE(NOTE_A, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(0), 1, // "KU"
+    TRACK_NOTE(NOTE_B, A7, DURATION_HALF), TRACK_LYRIC | TRACK_ABS, 3, 153, // "RA\n"
+    TRACK_NOTE(NOTE_A, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_ABS, 4, 77, // "YA"
+    TRACK_NOTE(NOTE_B, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(0), 5, // "YO"
+    TRACK_NOTE(NOTE_C, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(0), 6, // "I "
+    TRACK_NOTE(NOTE_B, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(0), 7, // "NO "
+    TRACK_NOTE(NOTE_A, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(-1), 8, // "SO"
+    TRACK_NOTE(NOTE_B, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_ABS, 2, 39, // "RA "
+    TRACK_NOTE(NOTE_A, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(-1), 9, // "-"
+    TRACK_NOTE(NOTE_F, A7, DURATION_HALF), TRACK_LYRIC | TRACK_ABS, 10, 154, // "WA\n"
+    TRACK_NOTE(NOTE_E, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_ABS, 11, 77, // "MI"
+    TRACK_NOTE(NOTE_D, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(-1), 12, // "WA"
+    TRACK_NOTE(NOTE_E, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(1), 13, // "TA"
+    TRACK_NOTE(NOTE_F, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(0), 14, // "SU "
+    TRACK_NOTE(NOTE_E, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(0), 15, // "KA"
+    TRACK_NOTE(NOTE_E, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_ABS, 16, 38, // "GI"
+    TRACK_NOTE(NOTE_C, A8, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(1), 9, // "-"
+    TRACK_NOTE(NOTE_B, A8, DURATION_HALF), TRACK_LYRIC | TRACK_ABS, 17, 153, // "RI\n"
+    TRACK_NOTE(NOTE_A, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_ABS, 15, 77, // "KA"
+    TRACK_NOTE(NOTE_B, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(0), 18, // "SU"
+    TRACK_NOTE(NOTE_C, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(0), 19, // "MI "
+    TRACK_NOTE(NOTE_B, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(-1), 20, // "KA "
+    TRACK_NOTE(NOTE_A, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(1), 1, // "KU"
+    TRACK_NOTE(NOTE_B, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_ABS, 21, 39, // "MO "
+    TRACK_NOTE(NOTE_A, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(-1), 9, // "-"
+    TRACK_NOTE(NOTE_F, A7, DURATION_HALF), TRACK_LYRIC | TRACK_ABS, 22, 154, // "KA\n"
+    TRACK_NOTE(NOTE_E, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_ABS, 23, 76, // "NI"
+    TRACK_NOTE(NOTE_D, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(1), 24, // "O"
+    TRACK_NOTE(NOTE_E, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(0), 6, // "I "
+    TRACK_NOTE(NOTE_F, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(0), 25, // "ZO "
+    TRACK_NOTE(NOTE_E, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(0), 26, // "I"
+    TRACK_NOTE(NOTE_E, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_ABS, 27, 38, // "ZU"
+    TRACK_NOTE(NOTE_C, A8, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(0), 9, // "-"
+    TRACK_NOTE(NOTE_B, A8, DURATION_HALF), TRACK_LYRIC | TRACK_ABS, 28, 154, // "RU\n"
+    TRACK_NOTE(NOTE_A, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_ABS, 26, 77, // "I"
+    TRACK_NOTE(NOTE_A, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(0), 29, // "ZA"
+    TRACK_NOTE(NOTE_B, A7, DURATION_HALF), TRACK_LYRIC | TRACK_ABS, 30, 153, // "YA "
+    TRACK_NOTE(NOTE_A, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_ABS, 26, 77, // "I"
+    TRACK_NOTE(NOTE_A, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(0), 29, // "ZA"
+    TRACK_NOTE(NOTE_B, A7, DURATION_HALF), TRACK_LYRIC | TRACK_ABS, 31, 153, // "YA\n"
+    TRACK_NOTE(NOTE_E, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(1), 11, // "MI"
+    TRACK_NOTE(NOTE_F, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(0), 32, // "NI "
+    TRACK_NOTE(NOTE_B, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_ABS, 33, 115, // "YU"
+    TRACK_NOTE(NOTE_A, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_DELTA(0), 9, // "-"
+    TRACK_NOTE(NOTE_F, A7, DURATION_QUARTER), TRACK_LYRIC | TRACK_ABS, 15, 154, // "KA"
+    TRACK_NOTE(NOTE_E, A7, DURATION_HALF), TRACK_LYRIC | TRACK_DELTA(-1), 34, // "N\n"
+    TRACK_END
+};
 
-    { .note = NOTE_A, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "SA" },
-    { .note = NOTE_A, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "KU" },
-    { .note = NOTE_B, .octave = A7, .duration = DURATION_HALF,    .length = 200, .lyric = "RA\n" },
+const char track_lyrics[] =
+    "SA" "\0"
+    "KU" "\0"
+    "RA " "\0"
+    "RA\n" "\0"
+    "YA" "\0"
+    "YO" "\0"
+    "I " "\0"
+    "NO " "\0"
+    "SO" "\0"
+    "-" "\0"
+    "WA\n" "\0"
+    "MI" "\0"
+    "WA" "\0"
+    "TA" "\0"
+    "SU " "\0"
+    "KA" "\0"
+    "GI" "\0"
+    "RI\n" "\0"
+    "SU" "\0"
+    "MI " "\0"
+    "KA " "\0"
+    "MO " "\0"
+    "KA\n" "\0"
+    "NI" "\0"
+    "O" "\0"
+    "ZO " "\0"
+    "I" "\0"
+    "ZU" "\0"
+    "RU\n" "\0"
+    "ZA" "\0"
+    "YA " "\0"
+    "YA\n" "\0"
+    "NI " "\0"
+    "YU" "\0"
+    "N\n" "\0";
 
-    { .note = NOTE_A, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "YA" },
-    { .note = NOTE_B, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "YO" },
-    { .note = NOTE_C, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "I " },
-    { .note = NOTE_B, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "NO " },
-    { .note = NOTE_A, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "SO" },
-    { .note = NOTE_B, .octave = A7, .duration = DURATION_QUARTER, .length = 50,  .lyric = "RA " },
-    { .note = NOTE_A, .octave = A7, .duration = DURATION_QUARTER, .length = 50,  .lyric = "-" },
-    { .note = NOTE_F, .octave = A7, .duration = DURATION_HALF,    .length = 200, .lyric = "WA\n" },
+const uint16_t track_lyric_offset[] = {
+    0, 3, 6, 10, 14, 17, 20, 23,
+    27, 30, 32, 36, 39, 42, 45, 49,
+    52, 55, 59, 62, 66, 70, 74, 78,
+    81, 83, 87, 89, 92, 96, 99, 103,
+    107, 111, 114,
+};
 
-    { .note = NOTE_E, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "MI" },
-    { .note = NOTE_D, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "WA" },
-    { .note = NOTE_E, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "TA" },
-    { .note = NOTE_F, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "SU " },
-    { .note = NOTE_E, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "KA" },
-    { .note = NOTE_E, .octave = A7, .duration = DURATION_QUARTER, .length = 50,  .lyric = "GI" },
-    { .note = NOTE_C, .octave = A8, .duration = DURATION_QUARTER, .length = 50,  .lyric = "-" },
-    { .note = NOTE_B, .octave = A8, .duration = DURATION_HALF,    .length = 200, .lyric = "RI\n" },
-
-    { .note = NOTE_A, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "KA" },
-    { .note = NOTE_B, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "SU" },
-    { .note = NOTE_C, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "MI " },
-    { .note = NOTE_B, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "KA " },
-    { .note = NOTE_A, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "KU" },
-    { .note = NOTE_B, .octave = A7, .duration = DURATION_QUARTER, .length = 50,  .lyric = "MO " },
-    { .note = NOTE_A, .octave = A7, .duration = DURATION_QUARTER, .length = 50,  .lyric = "-" },
-    { .note = NOTE_F, .octave = A7, .duration = DURATION_HALF,    .length = 200, .lyric = "KA\n" },
-
-    { .note = NOTE_E, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "NI" },
-    { .note = NOTE_D, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "O" },
-    { .note = NOTE_E, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "I " },
-    { .note = NOTE_F, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "ZO " },
-    { .note = NOTE_E, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "I" },
-    { .note = NOTE_E, .octave = A7, .duration = DURATION_QUARTER, .length = 50,  .lyric = "ZU" },
-    { .note = NOTE_C, .octave = A8, .duration = DURATION_QUARTER, .length = 50,  .lyric = "-" },
-    { .note = NOTE_B, .octave = A8, .duration = DURATION_HALF,    .length = 200, .lyric = "RU\n" },
-
-    { .note = NOTE_A, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "I" },
-    { .note = NOTE_A, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "ZA" },
-    { .note = NOTE_B, .octave = A7, .duration = DURATION_HALF,    .length = 200, .lyric = "YA " },
-    { .note = NOTE_A, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "I" },
-    { .note = NOTE_A, .octave = A7, .duration = DURATION_QUARTER, .length = 100, .lyric = "ZA" },
-    { .note = NOTE_B, .octave = A7, .duration = DURATION_HALF,    .length = 200, .lyric = "YA\n" },
-
-    { .note = NOTE_E, .octave = A7, .duration = DURATION_QUARTER, .length = 200, .lyric = "MI" },
-    { .note = NOTE_F, .octave = A7, .duration = DURATION_QUARTER, .length = 200, .lyric = "NI " },
-    { .note = NOTE_B, .octave = A7, .duration = DURATION_QUARTER, .length = 150, .lyric = "YU" },
-    { .note = NOTE_A, .octave = A7, .duration = DURATION_QUARTER, .length = 150, .lyric = "-" },
-    { .note = NOTE_F, .octave = A7, .duration = DURATION_QUARTER, .length = 200, .lyric = "KA" },
-    { .note = NOTE_E, .octave = A7, .duration = DURATION_HALF,    .length = 200, .lyric = "N\n" },
-};
\ No newline at end of file
+const struct song_t track = { track_notes, track_lyrics, track_lyric_offset };